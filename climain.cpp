@@ -0,0 +1,672 @@
+#include "halflifemodel.h"
+#include "vfs.h"
+
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// headless batch loader, walks directories and .pak archives and loads every model found printing stats as JSON lines
+// usage: hlmvqt-cli [-j threads] [--lazy] [--cache dir] [--cache-budget mb] [--sequential-reads] [--cold] [--scan] [--vcache-opt] [--quat-rotations] [--bake-poses mb] [--playback] <file.mdl | file.pak | directory>...
+//        hlmvqt-cli [--vcache-opt] --synth-mesh triangles
+
+using CliClock = std::chrono::steady_clock;
+
+static double MillisecondsSince(const CliClock::time_point& start) {
+    return std::chrono::duration<double, std::milli>(CliClock::now() - start).count();
+}
+
+
+// every worker owns a queue, takes its own newest tasks first and steals the oldest ones from others when out of work
+class WorkStealingPool {
+public:
+    using Task = std::function<void(const size_t workerIdx)>;
+
+    explicit WorkStealingPool(const size_t numThreads)
+        : mPending(0)
+    {
+        mQueues.resize(std::max<size_t>(1, numThreads));
+        for (StrongPtr<TaskQueue>& queue : mQueues) {
+            queue = MakeStrongPtr<TaskQueue>();
+        }
+    }
+
+    size_t GetThreadsCount() const {
+        return mQueues.size();
+    }
+
+    // tasks push their subtasks to their own queue, so the work spreads out only by stealing
+    void Push(const size_t workerIdx, Task task) {
+        ++mPending;
+
+        TaskQueue& queue = *mQueues[workerIdx % mQueues.size()];
+        std::lock_guard<std::mutex> guard(queue.lock);
+        queue.tasks.push_back(std::move(task));
+    }
+
+    // returns when all the tasks, including the ones pushed meanwhile, are done
+    void Run() {
+        MyArray<std::thread> threads;
+        for (size_t i = 1; i < mQueues.size(); ++i) {
+            threads.emplace_back([this, i]() {
+                this->WorkerLoop(i);
+            });
+        }
+        this->WorkerLoop(0);
+        for (std::thread& t : threads) {
+            t.join();
+        }
+    }
+
+private:
+    struct TaskQueue {
+        std::mutex      lock;
+        MyDeque<Task>   tasks;
+    };
+
+    bool TryPop(const size_t workerIdx, Task& task) {
+        {
+            TaskQueue& own = *mQueues[workerIdx];
+            std::lock_guard<std::mutex> guard(own.lock);
+            if (!own.tasks.empty()) {
+                task = std::move(own.tasks.back());
+                own.tasks.pop_back();
+                return true;
+            }
+        }
+
+        for (size_t i = 1; i < mQueues.size(); ++i) {
+            TaskQueue& victim = *mQueues[(workerIdx + i) % mQueues.size()];
+            std::lock_guard<std::mutex> guard(victim.lock);
+            if (!victim.tasks.empty()) {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void WorkerLoop(const size_t workerIdx) {
+        size_t idleSpins = 0;
+        while (mPending > 0) {
+            Task task;
+            if (this->TryPop(workerIdx, task)) {
+                task(workerIdx);
+                --mPending;
+                idleSpins = 0;
+            } else if (++idleSpins < 64) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+        }
+    }
+
+private:
+    MyArray<StrongPtr<TaskQueue>>   mQueues;
+    std::atomic<size_t>             mPending;   // pushed and not yet finished
+};
+
+
+struct CliOptions {
+    size_t          numThreads = 0;
+    bool            lazySequences = false;
+    bool            sequentialReads = false;
+    bool            coldCache = false;
+    bool            scanOnly = false;
+    bool            optimizeVertexCache = false;
+    bool            precomputeRotations = false;
+    size_t          bakedPosesBudget = 0;
+    bool            playback = false;
+    size_t          synthMeshTriangles = 0;
+    fs::path        cacheDir;
+    size_t          cacheBudget = 0;
+    MyArray<fs::path> paths;
+};
+
+struct CliTotals {
+    std::atomic<size_t>     filesLoaded{ 0 };
+    std::atomic<size_t>     filesFailed{ 0 };
+    std::atomic<uint64_t>   bytesLoaded{ 0 };
+};
+
+static bool IsModelFile(const fs::path& path) {
+    CharString ext = path.extension().u8string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](const char c) { return scast<char>(std::tolower(scast<unsigned char>(c))); });
+    return ext == ".mdl";
+}
+
+static CharString JsonEscape(const CharString& str) {
+    CharString result;
+    result.reserve(str.length() + 2);
+    for (const char c : str) {
+        switch (c) {
+            case '"':  result += "\\\""; break;
+            case '\\': result += "\\\\"; break;
+            case '\n': result += "\\n"; break;
+            case '\r': result += "\\r"; break;
+            case '\t': result += "\\t"; break;
+            default:
+                if (scast<unsigned char>(c) < 0x20) {
+                    char buffer[8];
+                    snprintf(buffer, sizeof(buffer), "\\u%04x", scast<unsigned int>(c));
+                    result += buffer;
+                } else {
+                    result += c;
+                }
+        }
+    }
+    return result;
+}
+
+static std::mutex sOutputLock;
+
+static void PrintLine(const CharString& line) {
+    std::lock_guard<std::mutex> guard(sOutputLock);
+    fwrite(line.data(), 1, line.length(), stdout);
+    fputc('\n', stdout);
+}
+
+static CharString JsonStringsArray(const MyArray<CharString>& strings) {
+    CharString result = "[";
+    for (size_t i = 0; i < strings.size(); ++i) {
+        result += (i ? ",\"" : "\"") + JsonEscape(strings[i]) + "\"";
+    }
+    return result + "]";
+}
+
+// header and names only, nothing gets decoded, so there's no file size either (that'd be one more stat per file)
+static void ScanModelTask(const fs::path& path, CliTotals& totals) {
+    const CliClock::time_point scanStart = CliClock::now();
+    HalfLifeModelInfo info;
+    const bool scanned = HalfLifeModel::ScanInfo(path, info);
+    const double scanMs = MillisecondsSince(scanStart);
+
+    char buffer[512];
+    CharString line = "{\"path\":\"" + JsonEscape(path.u8string()) + "\"";
+    if (!scanned) {
+        ++totals.filesFailed;
+        snprintf(buffer, sizeof(buffer), ",\"ok\":false,\"scanMs\":%.3f}", scanMs);
+        PrintLine(line + buffer);
+        return;
+    }
+
+    ++totals.filesLoaded;
+
+    MyArray<CharString> bodyPartNames, sequenceNames, textureNames;
+    size_t numSubModels = 0;
+    for (const HalfLifeModelInfoBodypart& bodyPart : info.bodyParts) {
+        bodyPartNames.push_back(bodyPart.name);
+        numSubModels += bodyPart.subModels.size();
+    }
+    for (const HalfLifeModelInfoSequence& sequence : info.sequences) {
+        sequenceNames.push_back(sequence.name);
+    }
+    for (const HalfLifeModelInfoTexture& texture : info.textures) {
+        textureNames.push_back(texture.name);
+    }
+
+    snprintf(buffer, sizeof(buffer),
+             ",\"ok\":true,\"version\":%u,\"bodyParts\":%zu,\"subModels\":%zu,\"bones\":%zu,\"sequences\":%zu,\"seqGroups\":%zu"
+             ",\"textures\":%zu,\"skins\":%zu,\"attachments\":%zu,\"hitBoxes\":%zu,\"scanMs\":%.3f",
+             info.version, info.bodyParts.size(), numSubModels, info.bones.size(), info.sequences.size(), info.sequenceGroups.size(),
+             info.textures.size(), info.numSkins, info.numAttachments, info.numHitBoxes, scanMs);
+    line += ",\"name\":\"" + JsonEscape(info.name) + "\"" + buffer;
+    line += ",\"bodyPartNames\":" + JsonStringsArray(bodyPartNames);
+    line += ",\"sequenceNames\":" + JsonStringsArray(sequenceNames);
+    line += ",\"textureNames\":" + JsonStringsArray(textureNames) + "}";
+    PrintLine(line);
+}
+
+struct PlaybackStats {
+    double  firstPassMs;
+    double  skeletonNs;     // average over the passes after the first one
+};
+
+// plays all the sequences through like a viewer would, the first pass also pays for lazy decoding and baking
+static PlaybackStats MeasurePlayback(const HalfLifeModel& model) {
+    constexpr float kFrameStep = 0.25f;
+    constexpr size_t kNumPasses = 4;
+
+    const MyArray<float> controllerValues(model.GetBoneControllersCount(), 0.0f);
+    MyArray<mat4f> skeleton(model.GetBonesCount());
+
+    PlaybackStats result = {};
+    size_t numSkeletons = 0;
+    double repeatedMs = 0.0;
+    for (size_t pass = 0; pass < kNumPasses; ++pass) {
+        const CliClock::time_point passStart = CliClock::now();
+        for (size_t i = 0; i < model.GetSequencesCount(); ++i) {
+            const float numFrames = scast<float>(model.GetSequence(i)->GetFramesCount());
+            for (float frame = 0.0f; frame < numFrames; frame += kFrameStep) {
+                model.CalculateSkeleton(frame, i, controllerValues.data(), skeleton.data());
+                numSkeletons += (pass > 0) ? 1 : 0;
+            }
+        }
+
+        if (pass > 0) {
+            repeatedMs += MillisecondsSince(passStart);
+        } else {
+            result.firstPassMs = MillisecondsSince(passStart);
+        }
+    }
+
+    result.skeletonNs = numSkeletons ? (repeatedMs * 1e6 / scast<double>(numSkeletons)) : 0.0;
+    return result;
+}
+
+// synthetic models for timing the geometry expansion (welding and the vertex cache optimization) against the triangles count
+// a single submodel made of kSynthGridSize x kSynthGridSize vertex grid tiles, one triangle strip per grid row,
+// every tile gets its own range of v, so nothing welds across the tiles and the vertices grow along with the triangles
+constexpr int kSynthGridSize = 128;
+constexpr size_t kSynthTrianglesPerRow = 2 * (kSynthGridSize - 1);
+constexpr size_t kSynthMaxTiles = 32768 / kSynthGridSize - 1;    // v has to fit into int16_t
+constexpr size_t kSynthMaxTriangles = kSynthMaxTiles * (kSynthGridSize - 1) * kSynthTrianglesPerRow;
+
+template <typename T>
+static void PatchStruct(MemWriteStream& stream, const size_t offset, const T& s) {
+    memcpy(stream.Data() + offset, &s, sizeof(T));
+}
+
+// one bone and one single frame sequence with no animation, so the model loads like any real one
+static MemStream BuildSyntheticModel(const size_t numTriangles, studiohdr_t& stdhdr) {
+    const size_t numRows = (std::min(numTriangles, kSynthMaxTriangles) + kSynthTrianglesPerRow - 1) / kSynthTrianglesPerRow;
+
+    MemWriteStream stream;
+    stdhdr = {};
+    stdhdr.magic = scast<int>(MakeFourcc<'I','D','S','T'>());
+    stdhdr.version = 10;
+    strcpy(stdhdr.name, "synthetic.mdl");
+    stream.WriteStruct(stdhdr);
+
+    mstudiobone_t bone = {};
+    strcpy(bone.name, "root");
+    bone.parent = -1;
+    for (size_t i = 0; i < 6; ++i) {
+        bone.bonecontroller[i] = -1;
+        bone.scale[i] = 1.0f;
+    }
+    stdhdr.numBones = 1;
+    stdhdr.offsetBones = scast<int>(stream.Length());
+    stream.WriteStruct(bone);
+
+    mstudioseqgroup_t seqGroup = {};
+    strcpy(seqGroup.label, "default");
+    stdhdr.numSeqGroups = 1;
+    stdhdr.offsetSeqGroups = scast<int>(stream.Length());
+    stream.WriteStruct(seqGroup);
+
+    const size_t seqDescOffset = stream.Length();
+    mstudioseqdesc_t seqDesc = {};
+    strcpy(seqDesc.label, "idle");
+    seqDesc.fps = 30.0f;
+    seqDesc.numFrames = 1;
+    seqDesc.numblends = 1;
+    stdhdr.numSequences = 1;
+    stdhdr.offsetSequences = scast<int>(seqDescOffset);
+    stream.WriteStruct(seqDesc);
+
+    // all the channels are zero
+    seqDesc.offsetAnimData = scast<int>(stream.Length());
+    stream.WriteStruct(mstudioanim_t{});
+    PatchStruct(stream, seqDescOffset, seqDesc);
+
+    mstudiobodyparts_t bodyPart = {};
+    strcpy(bodyPart.name, "body");
+    bodyPart.numModels = 1;
+    stdhdr.numBodyParts = 1;
+    stdhdr.offsetBodyParts = scast<int>(stream.Length());
+    bodyPart.offsetModels = stdhdr.offsetBodyParts + scast<int>(sizeof(bodyPart));
+    stream.WriteStruct(bodyPart);
+
+    const size_t mdlHdrOffset = stream.Length();
+    mstudiomodel_t mdlHdr = {};
+    strcpy(mdlHdr.name, "grid");
+    mdlHdr.numMeshes = 1;
+    mdlHdr.numVertices = kSynthGridSize * kSynthGridSize;
+    mdlHdr.numNormals = 1;
+    stream.WriteStruct(mdlHdr);
+
+    const size_t meshOffset = stream.Length();
+    mstudiomesh_t mesh = {};
+    mesh.numTriangles = scast<int>(numRows * kSynthTrianglesPerRow);
+    stream.WriteStruct(mesh);
+
+    mdlHdr.offsetMeshes = scast<int>(meshOffset);
+    mdlHdr.offsetVerices = scast<int>(stream.Length());
+    for (int y = 0; y < kSynthGridSize; ++y) {
+        for (int x = 0; x < kSynthGridSize; ++x) {
+            stream.WriteStruct(vec3f(scast<float>(x), scast<float>(y), 0.0f));
+        }
+    }
+    mdlHdr.offsetVBonesIndices = scast<int>(stream.Length());
+    for (int i = 0; i < mdlHdr.numVertices; ++i) {
+        stream.WriteU8(0);
+    }
+    mdlHdr.offsetNormals = scast<int>(stream.Length());
+    stream.WriteStruct(vec3f(0.0f, 0.0f, 1.0f));
+    mdlHdr.offsetNBonesIndices = scast<int>(stream.Length());
+    stream.WriteU8(0);
+    PatchStruct(stream, mdlHdrOffset, mdlHdr);
+
+    stream.Align(sizeof(int16_t));
+    mesh.offsetTriangles = scast<int>(stream.Length());
+    PatchStruct(stream, meshOffset, mesh);
+    for (size_t row = 0; row < numRows; ++row) {
+        const int tileV = scast<int>(row / (kSynthGridSize - 1)) * kSynthGridSize;
+        const int y = scast<int>(row % (kSynthGridSize - 1));
+        stream.WriteI16(scast<int16_t>(2 * kSynthGridSize));
+        for (int x = 0; x < kSynthGridSize; ++x) {
+            for (const int rowY : { y + 1, y }) {
+                stream.WriteI16(scast<int16_t>(rowY * kSynthGridSize + x));     // vertex
+                stream.WriteI16(0);                                             // normal
+                stream.WriteI16(scast<int16_t>(x));                             // u
+                stream.WriteI16(scast<int16_t>(tileV + rowY));                  // v
+            }
+        }
+    }
+    stream.WriteI16(0);
+
+    stdhdr.length = scast<int>(stream.Length());
+    PatchStruct(stream, 0, stdhdr);
+
+    void* data = malloc(stream.Length());
+    memcpy(data, stream.Data(), stream.Length());
+    return MemStream(data, stream.Length(), true);
+}
+
+// doubles the triangles count from 1024 up to `maxTriangles`, every size is loaded a few times and the best time is reported
+static void RunSyntheticMeshBenchmark(const size_t maxTriangles, const CliOptions& options) {
+    constexpr size_t kNumRuns = 5;
+
+    for (size_t numTriangles = 1024; numTriangles <= std::min(maxTriangles, kSynthMaxTriangles); numTriangles *= 2) {
+        studiohdr_t stdhdr;
+        MemStream modelStream = BuildSyntheticModel(numTriangles, stdhdr);
+
+        HalfLifeModelLoadOptions loadOptions;
+        loadOptions.numThreads = 1;
+        loadOptions.optimizeVertexCache = options.optimizeVertexCache;
+
+        float bestMs = std::numeric_limits<float>::max();
+        size_t numVertices = 0, numIndices = 0;
+        HalfLifeModelLoadStats stats;
+        for (size_t run = 0; run < kNumRuns; ++run) {
+            HalfLifeModel model;
+            model.SetLoadOptions(loadOptions);
+            modelStream.SetCursor(0);
+            if (!model.LoadFromMemStream(modelStream, stdhdr)) {
+                PrintLine("{\"synthTriangles\":" + std::to_string(numTriangles) + ",\"ok\":false}");
+                return;
+            }
+
+            if (model.GetLoadStats().geometryMs < bestMs) {
+                const HalfLifeModelStudioModel* smdl = model.GetBodyPart(0)->GetStudioModel(0);
+                bestMs = model.GetLoadStats().geometryMs;
+                stats = model.GetLoadStats();
+                numVertices = smdl->GetVerticesCount();
+                numIndices = smdl->GetIndicesCount();
+            }
+        }
+
+        char buffer[512];
+        snprintf(buffer, sizeof(buffer),
+                 "{\"synthTriangles\":%zu,\"ok\":true,\"vertices\":%zu,\"indices\":%zu,\"acmrBefore\":%.3f,\"acmrAfter\":%.3f"
+                 ",\"geometryMs\":%.3f,\"nsPerTriangle\":%.1f}",
+                 numIndices / 3, numVertices, numIndices, stats.acmrBefore, stats.acmrAfter,
+                 bestMs, scast<double>(bestMs) * 1e6 / scast<double>(std::max<size_t>(1, numIndices / 3)));
+        PrintLine(buffer);
+    }
+}
+
+static void LoadModelTask(const fs::path& path, const CliOptions& options, CliTotals& totals) {
+    if (options.scanOnly) {
+        ScanModelTask(path, totals);
+        return;
+    }
+
+    VFSFileInfo fileInfo = {};
+    VirtualFileSystem::GetFileInfo(path, fileInfo);
+    const uint64_t fileSize = fileInfo.size;
+
+    // parallelism is across the models, so every model loads on its own thread
+    HalfLifeModelLoadOptions loadOptions;
+    loadOptions.lazySequences = options.lazySequences;
+    loadOptions.numThreads = 1;
+    loadOptions.concurrentReads = !options.sequentialReads;
+    loadOptions.optimizeVertexCache = options.optimizeVertexCache;
+    loadOptions.precomputeRotations = options.precomputeRotations;
+    loadOptions.bakedPosesBudget = options.bakedPosesBudget;
+    loadOptions.cacheDir = options.cacheDir;
+    loadOptions.cacheDirBudget = options.cacheBudget;
+
+    const CliClock::time_point loadStart = CliClock::now();
+    HalfLifeModel model;
+    model.SetLoadOptions(loadOptions);
+    const bool loaded = model.LoadFromPath(path);
+    const double loadMs = MillisecondsSince(loadStart);
+
+    char buffer[512];
+    CharString line = "{\"path\":\"" + JsonEscape(path.u8string()) + "\"";
+    if (!loaded) {
+        ++totals.filesFailed;
+        snprintf(buffer, sizeof(buffer), ",\"ok\":false,\"fileBytes\":%llu,\"loadMs\":%.3f}", scast<unsigned long long>(fileSize), loadMs);
+        PrintLine(line + buffer);
+        return;
+    }
+
+    ++totals.filesLoaded;
+    totals.bytesLoaded += fileSize;
+
+    size_t numSubModels = 0, numVertices = 0, numIndices = 0;
+    for (size_t i = 0; i < model.GetBodyPartsCount(); ++i) {
+        const HalfLifeModelBodypart* bodyPart = model.GetBodyPart(i);
+        for (size_t j = 0; j < bodyPart->GetStudioModelsCount(); ++j) {
+            const HalfLifeModelStudioModel* smdl = bodyPart->GetStudioModel(j);
+            ++numSubModels;
+            numVertices += smdl->GetVerticesCount();
+            numIndices += smdl->GetIndicesCount();
+        }
+    }
+
+    size_t textureBytes = 0;
+    for (size_t i = 0; i < model.GetTexturesCount(); ++i) {
+        const HalfLifeModelTexture& texture = model.GetTexture(i);
+        textureBytes += texture.data.size() + texture.palette.size();
+    }
+
+    const HalfLifeModelLoadStats& stats = model.GetLoadStats();
+    snprintf(buffer, sizeof(buffer),
+             ",\"ok\":true,\"fileBytes\":%llu,\"bodyParts\":%zu,\"subModels\":%zu,\"vertices\":%zu,\"indices\":%zu"
+             ",\"bones\":%zu,\"sequences\":%zu,\"textures\":%zu,\"textureBytes\":%zu,\"animBytes\":%zu,\"arenaBytes\":%zu"
+             ",\"acmrBefore\":%.3f,\"acmrAfter\":%.3f,\"loadMs\":%.3f,\"fromCache\":%s",
+             scast<unsigned long long>(fileSize), model.GetBodyPartsCount(), numSubModels, numVertices, numIndices,
+             model.GetBonesCount(), model.GetSequencesCount(), model.GetTexturesCount(), textureBytes, model.GetDecodedAnimSize(), stats.arenaBytes,
+             stats.acmrBefore, stats.acmrAfter, loadMs, stats.fromCache ? "true" : "false");
+    line += buffer;
+
+    if (options.playback) {
+        const PlaybackStats playback = MeasurePlayback(model);
+        snprintf(buffer, sizeof(buffer), ",\"firstPlayMs\":%.3f,\"skeletonNs\":%.1f,\"bakedBytes\":%zu",
+                 playback.firstPassMs, playback.skeletonNs, model.GetBakedPosesSize());
+        line += buffer;
+    }
+
+    PrintLine(line + "}");
+}
+
+// archived models are loaded straight from the archive, just like the loose ones
+static void WalkArchiveTask(const fs::path& archivePath, const CliOptions& options, CliTotals& totals, WorkStealingPool& pool, const size_t workerIdx) {
+    const RefPtr<const PakArchive> archive = VirtualFileSystem::MountArchive(archivePath);
+    if (!archive) {
+        ++totals.filesFailed;
+        PrintLine("{\"path\":\"" + JsonEscape(archivePath.u8string()) + "\",\"ok\":false}");
+        return;
+    }
+
+    for (size_t i = 0; i < archive->GetFilesCount(); ++i) {
+        const fs::path modelPath = VirtualFileSystem::MakeArchiveFilePath(archivePath, archive->GetFileName(i));
+        if (IsModelFile(modelPath) && !HalfLifeModel::IsCompanionFile(modelPath)) {
+            pool.Push(workerIdx, [modelPath, &options, &totals](const size_t) {
+                LoadModelTask(modelPath, options, totals);
+            });
+        }
+    }
+}
+
+static void WalkDirectoryTask(const fs::path& dirPath, const CliOptions& options, CliTotals& totals, WorkStealingPool& pool, const size_t workerIdx) {
+    std::error_code ec;
+    fs::directory_iterator it(dirPath, fs::directory_options::skip_permission_denied, ec);
+    for (const fs::directory_iterator end; !ec && it != end; it.increment(ec)) {
+        const fs::directory_entry& entry = *it;
+        const fs::path entryPath = entry.path();
+        std::error_code entryEc;
+        if (entry.is_directory(entryEc) && !entry.is_symlink(entryEc)) {
+            pool.Push(workerIdx, [entryPath, &options, &totals, &pool](const size_t idx) {
+                WalkDirectoryTask(entryPath, options, totals, pool, idx);
+            });
+        } else if (entry.is_regular_file(entryEc) && VirtualFileSystem::IsArchive(entryPath)) {
+            pool.Push(workerIdx, [entryPath, &options, &totals, &pool](const size_t idx) {
+                WalkArchiveTask(entryPath, options, totals, pool, idx);
+            });
+        } else if (entry.is_regular_file(entryEc) && IsModelFile(entryPath) && !HalfLifeModel::IsCompanionFile(entryPath)) {
+            pool.Push(workerIdx, [entryPath, &options, &totals](const size_t) {
+                LoadModelTask(entryPath, options, totals);
+            });
+        }
+    }
+}
+
+// asks the OS to drop the files from the page cache, so that the loading has to hit the disk (or the network)
+static void EvictFromPageCache(const fs::path& path) {
+    std::error_code ec;
+    if (fs::is_directory(path, ec)) {
+        for (fs::recursive_directory_iterator it(path, fs::directory_options::skip_permission_denied, ec), end; !ec && it != end; it.increment(ec)) {
+            std::error_code entryEc;
+            if (it->is_regular_file(entryEc)) {
+                EvictFromPageCache(it->path());
+            }
+        }
+        return;
+    }
+
+#ifndef _WIN32
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        ::close(fd);
+    }
+#endif
+}
+
+static void PrintUsage() {
+    fprintf(stderr, "usage: hlmvqt-cli [-j threads] [--lazy] [--cache dir] [--cache-budget mb] [--sequential-reads] [--cold] [--scan] [--vcache-opt] [--quat-rotations] [--bake-poses mb] [--playback] <file.mdl | file.pak | directory>...\n"
+                    "       hlmvqt-cli [--vcache-opt] --synth-mesh triangles\n"
+                    "  -j N                number of worker threads (default - all hardware threads)\n"
+                    "  --lazy              don't decode sequences animation\n"
+                    "  --cache dir         use (and fill) the post-processed models cache in `dir`\n"
+                    "  --cache-budget mb   delete the least recently used files of the cache above `mb` megabytes (default - no limit)\n"
+                    "  --sequential-reads  read the files of a model one after another instead of all at once\n"
+                    "  --cold              drop the files from the OS page cache before loading (not supported on Windows)\n"
+                    "  --scan              read just the headers and names (bones, bodyparts, sequences, textures), no geometry or animation\n"
+                    "  --vcache-opt        reorder the triangles and vertices for the GPU vertex cache (ACMR is reported either way)\n"
+                    "  --quat-rotations    precompute the bones rotations as quaternions when decoding sequences\n"
+                    "  --bake-poses mb     bake the sequences poses on the first playback, up to `mb` megabytes per model\n"
+                    "  --playback          play every sequence through after loading and report the time per skeleton\n"
+                    "  --synth-mesh N      time the geometry loading of generated grid meshes from 1024 up to N triangles, no files are read\n");
+}
+
+static bool ParseArgs(const int argc, char** argv, CliOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        const CharString arg = argv[i];
+        if (arg == "-j" && i + 1 < argc) {
+            options.numThreads = scast<size_t>(std::max(0, atoi(argv[++i])));
+        } else if (arg == "--lazy") {
+            options.lazySequences = true;
+        } else if (arg == "--sequential-reads") {
+            options.sequentialReads = true;
+        } else if (arg == "--cold") {
+            options.coldCache = true;
+        } else if (arg == "--scan") {
+            options.scanOnly = true;
+        } else if (arg == "--vcache-opt") {
+            options.optimizeVertexCache = true;
+        } else if (arg == "--quat-rotations") {
+            options.precomputeRotations = true;
+        } else if (arg == "--bake-poses" && i + 1 < argc) {
+            options.bakedPosesBudget = scast<size_t>(std::max(0, atoi(argv[++i]))) * 1024 * 1024;
+        } else if (arg == "--playback") {
+            options.playback = true;
+        } else if (arg == "--synth-mesh" && i + 1 < argc) {
+            options.synthMeshTriangles = scast<size_t>(std::max(0, atoi(argv[++i])));
+        } else if (arg == "--cache" && i + 1 < argc) {
+            options.cacheDir = fs::u8path(argv[++i]);
+        } else if (arg == "--cache-budget" && i + 1 < argc) {
+            options.cacheBudget = scast<size_t>(std::max(0, atoi(argv[++i]))) * 1024 * 1024;
+        } else if (arg == "-h" || arg == "--help" || (!arg.empty() && arg[0] == '-')) {
+            return false;
+        } else {
+            options.paths.push_back(fs::u8path(arg));
+        }
+    }
+
+    return !options.paths.empty() || options.synthMeshTriangles > 0;
+}
+
+int main(int argc, char** argv) {
+    CliOptions options;
+    if (!ParseArgs(argc, argv, options)) {
+        PrintUsage();
+        return 1;
+    }
+
+    if (options.synthMeshTriangles) {
+        RunSyntheticMeshBenchmark(options.synthMeshTriangles, options);
+        return 0;
+    }
+
+    if (options.coldCache) {
+        for (const fs::path& path : options.paths) {
+            EvictFromPageCache(path);
+        }
+    }
+
+    const size_t numThreads = options.numThreads ? options.numThreads : std::max<size_t>(1, std::thread::hardware_concurrency());
+    WorkStealingPool pool(numThreads);
+    CliTotals totals;
+
+    for (const fs::path& path : options.paths) {
+        std::error_code ec;
+        if (fs::is_directory(path, ec)) {
+            pool.Push(0, [path, &options, &totals, &pool](const size_t idx) {
+                WalkDirectoryTask(path, options, totals, pool, idx);
+            });
+        } else if (VirtualFileSystem::IsArchive(path) && fs::is_regular_file(path, ec)) {
+            pool.Push(0, [path, &options, &totals, &pool](const size_t idx) {
+                WalkArchiveTask(path, options, totals, pool, idx);
+            });
+        } else {
+            pool.Push(0, [path, &options, &totals](const size_t) {
+                LoadModelTask(path, options, totals);
+            });
+        }
+    }
+
+    const CliClock::time_point runStart = CliClock::now();
+    pool.Run();
+    const double runSec = std::max(MillisecondsSince(runStart) / 1000.0, 1e-6);
+
+    const size_t numLoaded = totals.filesLoaded;
+    const size_t numFailed = totals.filesFailed;
+    const double megabytes = scast<double>(totals.bytesLoaded.load()) / (1024.0 * 1024.0);
+    fprintf(stderr, "%zu models %s, %zu failed, %.2f MB in %.3f s on %zu threads: %.1f files/sec, %.2f MB/sec\n",
+            numLoaded, options.scanOnly ? "scanned" : "loaded", numFailed, megabytes, runSec, pool.GetThreadsCount(),
+            scast<double>(numLoaded + numFailed) / runSec, megabytes / runSec);
+
+    return numFailed ? 2 : 0;
+}
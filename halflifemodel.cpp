@@ -1,31 +1,344 @@
 #include "halflifemodel.h"
+#include "vfs.h"
 #include <fstream>
+#include <chrono>
 
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+// submodels up to this many vertices get 16-bit indices
+constexpr size_t kMaxShortIndexVertices = 0x10000;
+
+// welds identical vertices using an open addressing hash table (linear probing)
 struct VertexIndexer {
-    MyArray<uint16_t>            indices;
+    static constexpr uint32_t kEmptySlot = ~0u;
+
+    MyArray<uint32_t>            indices;   // narrowed to 16 bits later if the vertices allow
     MyArray<HalfLifeModelVertex> vertices;
+    MyArray<uint32_t>            table;     // indices into `vertices`
     AABBox                       bounds;
 
     VertexIndexer() {
         bounds.Reset();
     }
 
+    void Reserve(const size_t numCorners) {
+        indices.reserve(numCorners);
+        vertices.reserve(numCorners);
+        this->Rehash(numCorners * 2);
+    }
+
     void AddVertex(const vec3f& v, const vec3f& n, const vec2f& uv, const uint32_t bone) {
         const HalfLifeModelVertex vertex = { v, n, uv, bone };
-        auto it = std::find(vertices.begin(), vertices.end(), vertex);
-        uint16_t index;
-        if (it == vertices.end()) {
-            index = scast<uint16_t>(vertices.size());
+
+        if ((vertices.size() + 1) * 2 > table.size()) {
+            this->Rehash(table.size() * 2);
+        }
+
+        const size_t mask = table.size() - 1;
+        size_t slot = HashVertex(vertex) & mask;
+        while (table[slot] != kEmptySlot && vertices[table[slot]] != vertex) {
+            slot = (slot + 1) & mask;
+        }
+
+        uint32_t index;
+        if (table[slot] == kEmptySlot) {
+            table[slot] = scast<uint32_t>(vertices.size());
+            index = scast<uint32_t>(vertices.size());
             vertices.push_back(vertex);
 
             bounds.Absorb(v);
         } else {
-            index = scast<uint16_t>(std::distance(vertices.begin(), it));
+            index = table[slot];
         }
         indices.push_back(index);
     }
+
+private:
+    void Rehash(const size_t minSize) {
+        size_t newSize = 64;
+        while (newSize < minSize) {
+            newSize <<= 1;
+        }
+        if (newSize <= table.size()) {
+            return;
+        }
+
+        table.assign(newSize, kEmptySlot);
+        const size_t mask = newSize - 1;
+        for (size_t i = 0, num = vertices.size(); i < num; ++i) {
+            size_t slot = HashVertex(vertices[i]) & mask;
+            while (table[slot] != kEmptySlot) {
+                slot = (slot + 1) & mask;
+            }
+            table[slot] = scast<uint32_t>(i);
+        }
+    }
+
+    // must agree with HalfLifeModelVertex::operator==, so -0.0 and 0.0 have to hash the same
+    static size_t HashVertex(const HalfLifeModelVertex& vertex) {
+        const float values[8] = { vertex.pos.x, vertex.pos.y, vertex.pos.z,
+                                  vertex.normal.x, vertex.normal.y, vertex.normal.z,
+                                  vertex.uv.x, vertex.uv.y };
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (const float f : values) {
+            const float normalized = f + 0.0f;
+            uint32_t bits;
+            memcpy(&bits, &normalized, sizeof(bits));
+            hash = (hash ^ bits) * 0x100000001B3ull;
+        }
+        hash = (hash ^ vertex.boneIdx) * 0x100000001B3ull;
+        return scast<size_t>(hash ^ (hash >> 32));
+    }
+};
+
+// post-transform vertex cache as most GPUs have it, a FIFO of the last transformed vertices
+constexpr size_t kVertexCacheSize = 16;
+
+// transformed vertices per triangle is the ACMR (average cache miss ratio), 3 is the worst, 0.5 is about the best for a regular mesh
+// `timestamps` is the scratch memory, one entry per vertex
+static size_t CountVertexCacheMisses(const uint32_t* indices, const size_t numIndices, MyArray<uint32_t>& timestamps) {
+    std::fill(timestamps.begin(), timestamps.end(), 0u);
+
+    size_t misses = 0;
+    uint32_t time = scast<uint32_t>(kVertexCacheSize) + 1;
+    for (size_t i = 0; i < numIndices; ++i) {
+        uint32_t& stamp = timestamps[indices[i]];
+        if (time - stamp > kVertexCacheSize) {
+            stamp = time++;
+            ++misses;
+        }
+    }
+    return misses;
+}
+
+// reorders triangles for the post-transform vertex cache, Tom Forsyth's "Linear-Speed Vertex Cache Optimisation":
+// the triangle with the best scored vertices goes next, vertices score for being in the (simulated LRU) cache
+// and for having few triangles left, so the mesh is eaten up in compact patches without leaving lone triangles behind
+class VertexCacheOptimizer {
+    static constexpr int32_t kCacheSize = 16;
+    static constexpr size_t kNoTriangle = ~size_t(0);
+
+public:
+    explicit VertexCacheOptimizer(const size_t numVertices)
+        : mValence(numVertices, 0)
+        , mTrianglesStart(numVertices + 1, 0)
+        , mCachePos(numVertices, -1)
+        , mScore(numVertices, 0.0f) {
+    }
+
+    // `indices` are a triangle list, reordered in place
+    void Optimize(uint32_t* indices, const size_t numIndices) {
+        const size_t numTriangles = numIndices / 3;
+        if (numTriangles < 2) {
+            return;
+        }
+
+        // used vertices and the triangles of every one of them
+        mUsedVertices.clear();
+        for (size_t i = 0; i < numTriangles * 3; ++i) {
+            if (!mValence[indices[i]]++) {
+                mUsedVertices.push_back(indices[i]);
+            }
+        }
+        uint32_t offset = 0;
+        for (const uint32_t v : mUsedVertices) {
+            mTrianglesStart[v] = offset;
+            offset += mValence[v];
+        }
+        mVertexTriangles.resize(offset);
+        for (size_t tri = 0; tri < numTriangles; ++tri) {
+            for (size_t k = 0; k < 3; ++k) {
+                const uint32_t v = indices[tri * 3 + k];
+                mVertexTriangles[mTrianglesStart[v]++] = scast<uint32_t>(tri);
+            }
+        }
+        for (const uint32_t v : mUsedVertices) {
+            mTrianglesStart[v] -= mValence[v];
+            mScore[v] = VertexCacheOptimizer::CalcVertexScore(-1, mValence[v]);
+        }
+
+        mTriangleScore.resize(numTriangles);
+        mTriangleEmitted.assign(numTriangles, false);
+        for (size_t tri = 0; tri < numTriangles; ++tri) {
+            mTriangleScore[tri] = mScore[indices[tri * 3]] + mScore[indices[tri * 3 + 1]] + mScore[indices[tri * 3 + 2]];
+        }
+
+        MyArray<uint32_t> result;
+        result.reserve(numTriangles * 3);
+        mCache.clear();
+
+        size_t nextTriangle = this->FindBestTriangle(numTriangles);
+        size_t scanCursor = 0;
+        while (nextTriangle != kNoTriangle) {
+            const uint32_t* triVertices = indices + nextTriangle * 3;
+            result.insert(result.end(), triVertices, triVertices + 3);
+            mTriangleEmitted[nextTriangle] = true;
+
+            // emitted triangle goes to the front of the cache, the rest shifts back, whatever falls out of the end is dropped
+            mNewCache.assign(triVertices, triVertices + 3);
+            for (const uint32_t v : mCache) {
+                if (v != triVertices[0] && v != triVertices[1] && v != triVertices[2]) {
+                    mNewCache.push_back(v);
+                }
+            }
+            for (size_t k = 0; k < 3; ++k) {
+                this->RemoveVertexTriangle(triVertices[k], nextTriangle);
+            }
+
+            // only the triangles of the touched vertices change score, and the best next one is almost always among them
+            // (picked while the scores are still being updated, which is a bit off at times, but saves another pass)
+            nextTriangle = kNoTriangle;
+            float bestScore = -1.0f;
+            for (size_t i = 0; i < mNewCache.size(); ++i) {
+                const uint32_t v = mNewCache[i];
+                mCachePos[v] = (i < kCacheSize) ? scast<int32_t>(i) : -1;
+
+                const float score = VertexCacheOptimizer::CalcVertexScore(mCachePos[v], mValence[v]);
+                const float scoreDelta = score - mScore[v];
+                mScore[v] = score;
+
+                const uint32_t* triangles = mVertexTriangles.data() + mTrianglesStart[v];
+                for (uint32_t j = 0; j < mValence[v]; ++j) {
+                    const uint32_t tri = triangles[j];
+                    const float triScore = mTriangleScore[tri] + scoreDelta;
+                    mTriangleScore[tri] = triScore;
+                    if (triScore > bestScore) {
+                        bestScore = triScore;
+                        nextTriangle = tri;
+                    }
+                }
+            }
+
+            if (mNewCache.size() > scast<size_t>(kCacheSize)) {
+                mNewCache.resize(kCacheSize);
+            }
+            mCache.swap(mNewCache);
+
+            // cache ran dry, pick up any triangle left
+            if (nextTriangle == kNoTriangle) {
+                while (scanCursor < numTriangles && mTriangleEmitted[scanCursor]) {
+                    ++scanCursor;
+                }
+                nextTriangle = (scanCursor < numTriangles) ? scanCursor : kNoTriangle;
+            }
+        }
+
+        std::copy(result.begin(), result.end(), indices);
+
+        for (const uint32_t v : mUsedVertices) {
+            mValence[v] = 0;
+            mCachePos[v] = -1;
+        }
+    }
+
+private:
+    // scores only depend on small integers, so they are tabulated once
+    struct ScoreTables {
+        static constexpr uint32_t kMaxValence = 32;
+
+        float   cache[kCacheSize];
+        float   valence[kMaxValence + 1];
+
+        ScoreTables() {
+            for (int32_t i = 0; i < kCacheSize; ++i) {
+                // the last triangle's vertices score the same, so the order of its emission doesn't matter
+                cache[i] = (i < 3) ? 0.75f : std::pow(1.0f - scast<float>(i - 3) / scast<float>(kCacheSize - 3), 1.5f);
+            }
+            valence[0] = 0.0f;
+            for (uint32_t i = 1; i <= kMaxValence; ++i) {
+                valence[i] = 2.0f / std::sqrt(scast<float>(i));
+            }
+        }
+    };
+
+    static float CalcVertexScore(const int32_t cachePos, const uint32_t valence) {
+        static const ScoreTables sTables;
+
+        if (!valence) {
+            return -1.0f;
+        }
+
+        const float cacheScore = (cachePos >= 0) ? sTables.cache[cachePos] : 0.0f;
+        return cacheScore + sTables.valence[std::min(valence, ScoreTables::kMaxValence)];
+    }
+
+    size_t FindBestTriangle(const size_t numTriangles) const {
+        size_t best = kNoTriangle;
+        float bestScore = -1.0f;
+        for (size_t tri = 0; tri < numTriangles; ++tri) {
+            if (!mTriangleEmitted[tri] && mTriangleScore[tri] > bestScore) {
+                bestScore = mTriangleScore[tri];
+                best = tri;
+            }
+        }
+        return best;
+    }
+
+    void RemoveVertexTriangle(const uint32_t v, const size_t tri) {
+        uint32_t* triangles = mVertexTriangles.data() + mTrianglesStart[v];
+        uint32_t* last = triangles + mValence[v] - 1;
+        *std::find(triangles, last, scast<uint32_t>(tri)) = *last;
+        --mValence[v];
+    }
+
+private:
+    MyArray<uint32_t>   mValence;           // triangles left for every vertex
+    MyArray<uint32_t>   mTrianglesStart;    // first of them in mVertexTriangles
+    MyArray<uint32_t>   mVertexTriangles;
+    MyArray<int32_t>    mCachePos;
+    MyArray<float>      mScore;
+    MyArray<float>      mTriangleScore;
+    MyArray<bool>       mTriangleEmitted;
+    MyArray<uint32_t>   mUsedVertices;
+    MyArray<uint32_t>   mCache;
+    MyArray<uint32_t>   mNewCache;
 };
 
+// every mesh is a draw call of its own, so triangles are reordered within the meshes, while vertices are shared by all of them
+// and get renumbered in the order of first use, so the vertex fetch (and the CPU skinning) goes through memory front to back
+static void OptimizeMeshesVertexCache(const HalfLifeModelStudioMesh* meshes, const size_t numMeshes, MyArray<uint32_t>& indices, MyArray<HalfLifeModelVertex>& vertices) {
+    VertexCacheOptimizer optimizer(vertices.size());
+    for (size_t i = 0; i < numMeshes; ++i) {
+        optimizer.Optimize(indices.data() + meshes[i].indicesOffset, meshes[i].numIndices);
+    }
+
+    constexpr uint32_t kNotRemapped = ~0u;
+    MyArray<uint32_t> remap(vertices.size(), kNotRemapped);
+    MyArray<HalfLifeModelVertex> reordered;
+    reordered.reserve(vertices.size());
+    for (uint32_t& index : indices) {
+        if (remap[index] == kNotRemapped) {
+            remap[index] = scast<uint32_t>(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = scast<uint32_t>(remap[index]);
+    }
+    // not referenced by any triangle, but the bones view still shows them
+    for (size_t i = 0; i < vertices.size(); ++i) {
+        if (remap[i] == kNotRemapped) {
+            reordered.push_back(vertices[i]);
+        }
+    }
+
+    vertices.swap(reordered);
+}
+
+constexpr size_t kPaletteSize = 256 * 3;
+
+constexpr size_t kAnimFrameStride = sizeof(HalfLifeModelAnimFrame) / sizeof(int16_t);
+static_assert(kAnimFrameStride == 6, "HalfLifeModelAnimFrame must be exactly 6 tightly packed channels");
+static const uint8_t kBlackPalette[kPaletteSize] = {};
+
+using LoadClock = std::chrono::steady_clock;
+
+static float MillisecondsSince(const LoadClock::time_point& start) {
+    return std::chrono::duration<float, std::milli>(LoadClock::now() - start).count();
+}
+
 PACKED_STRUCT_BEGIN
 struct HLVertexCMD {
     int16_t vertex;
@@ -34,321 +347,808 @@ struct HLVertexCMD {
 } PACKED_STRUCT_END;
 
 
-static MemStream ReadFileToMemStream(const fs::path& filePath) {
-    std::ifstream file(filePath, std::ios::binary);
-    if (!file.is_open()) {
-        return {};
+// number of triangle list corners the tricmds will expand to
+static size_t CountTriCmdsCorners(const int16_t* tricmds) {
+    size_t result = 0;
+    int numVertices;
+    while ((numVertices = *(tricmds++)) != 0) {
+        numVertices = (numVertices < 0) ? -numVertices : numVertices;
+        result += (numVertices > 2) ? scast<size_t>((numVertices - 2) * 3) : 0;
+        tricmds += numVertices * 4;
+    }
+    return result;
+}
+
+// with concurrent reads the file is opened, mapped and prefetched on a thread of its own right away
+// (opening alone is a round trip on network shares), otherwise it's read on the calling thread once the result is asked for
+static std::future<MemStream> ReadFileAsync(const fs::path& filePath, const bool concurrent) {
+    if (!concurrent) {
+        return std::async(std::launch::deferred, VirtualFileSystem::ReadFile, filePath);
     }
 
-    file.seekg(0, std::ios::end);
-    const size_t fileSize = file.tellg();
-    char* memory = rcast<char*>(malloc(fileSize));
-    if (!memory) {
+    return std::async(std::launch::async, [filePath]() {
+        MemStream stream = VirtualFileSystem::ReadFile(filePath);
+        VirtualFileSystem::Prefetch(stream);
+        return stream;
+    });
+}
+
+template <size_t N>
+static CharString ScanName(const char (&name)[N]) {
+    return CharString(name, strnlen(name, N));
+}
+
+// tables in the scan are views right into the mapped file, so only the pages they are on get read,
+// a table that doesn't fit the file is taken as missing, same as the loader reading zeroes past the end
+template <typename T>
+static ArrayView<T> ScanTable(const MemStream& stream, const int offset, const int count) {
+    if (offset < 0 || count <= 0) {
         return {};
     }
+    return stream.GetView<T>(scast<size_t>(offset), scast<size_t>(count));
+}
 
-    file.seekg(0, std::ios::beg);
-    file.read(memory, fileSize);
-    file.close();
-
-    return MemStream(memory, fileSize, true);
+static void ScanTexturesInfo(const MemStream& stream, const studiohdr_t& stdhdr, HalfLifeModelInfo& info) {
+    const ArrayView<mstudiotexture_t> textures = ScanTable<mstudiotexture_t>(stream, stdhdr.offsetTextures, stdhdr.numTextures);
+    info.textures.resize(textures.size());
+    for (size_t i = 0; i < textures.size(); ++i) {
+        info.textures[i].name = ScanName(textures[i].name);
+        info.textures[i].width = scast<uint32_t>(textures[i].width);
+        info.textures[i].height = scast<uint32_t>(textures[i].height);
+    }
+    info.numSkins = scast<size_t>(std::max(0, stdhdr.numSkinFamilies));
 }
 
 // based on StudioModel::CalcBoneQuaternion from the original hlmv code by Mete Ciragan
 // some kind of RLE-like compression
-static int16_t DecodeAnimValue(const mstudioanim_t* animPtr, int frame, const size_t channel) {
+// decodes all frames of a single channel in one pass, `output` is written with `outputStride` step
+static void DecodeAnimChannel(const mstudioanim_t* animPtr, const size_t channel, const uint32_t numFrames, int16_t* output, const size_t outputStride) {
     if (!animPtr->offset[channel]) {
-        return 0;
+        for (uint32_t frame = 0; frame < numFrames; ++frame, output += outputStride) {
+            *output = 0;
+        }
+        return;
     }
 
     const mstudioanimvalue_t* valuePtr = rcast<const mstudioanimvalue_t*>(rcast<const char*>(animPtr) + animPtr->offset[channel]);
 
-    while (valuePtr->num.total <= frame) {
-        frame -= valuePtr->num.total;
-        valuePtr += valuePtr->num.valid + 1;
-
-        if (!valuePtr->num.total) {
-            return 0;
+    // runs are only walked forward, `runFrame` is the frame index relative to the current run
+    int runFrame = 0;
+    for (uint32_t frame = 0; frame < numFrames; ++frame, ++runFrame, output += outputStride) {
+        while (valuePtr->num.total <= runFrame) {
+            runFrame -= valuePtr->num.total;
+            valuePtr += valuePtr->num.valid + 1;
+
+            if (!valuePtr->num.total) {
+                // end of data, the rest of the frames are zeroes
+                for (; frame < numFrames; ++frame, output += outputStride) {
+                    *output = 0;
+                }
+                return;
+            }
         }
-    }
 
-    // Bah, missing blend!
-    if (valuePtr->num.valid > frame) {
-        return valuePtr[frame + 1].value;
-    } else {
-        // get last valid data block
-        return valuePtr[valuePtr->num.valid].value;
+        // Bah, missing blend!
+        if (valuePtr->num.valid > runFrame) {
+            *output = valuePtr[runFrame + 1].value;
+        } else {
+            // get last valid data block
+            *output = valuePtr[valuePtr->num.valid].value;
+        }
     }
 }
 
+// value of a bit-packed channel, `words` are the sequence anim bits (with the extra word at the end)
+static int16_t SampleAnimChannel(const HalfLifeModelAnimChannel& animChannel, const uint32_t* words, const uint32_t frame) {
+    if (!animChannel.bits) {
+        return animChannel.base;
+    }
 
-HalfLifeModel::HalfLifeModel()
-    : mActiveSkin(0)
-{
-}
-HalfLifeModel::~HalfLifeModel() {
+    const size_t bitPos = scast<size_t>(frame) * animChannel.bits;
+    const uint32_t* framesWords = words + animChannel.wordOffset + (bitPos >> 5);
+    const uint64_t packed = (scast<uint64_t>(framesWords[0]) | (scast<uint64_t>(framesWords[1]) << 32)) >> (bitPos & 31);
+    const uint32_t mask = (1u << animChannel.bits) - 1u;
+    return scast<int16_t>(animChannel.base + scast<int32_t>(scast<uint32_t>(packed) & mask));
 }
 
-bool HalfLifeModel::LoadFromPath(const fs::path& filePath) {
-    MemStream stream = ReadFileToMemStream(filePath);
-    if (!stream) {
-        return false;
-    }
+// smallest three: the largest component is dropped and made positive (q and -q are the same rotation),
+// the other three are within +-1/sqrt(2), so they are scaled to [-1, 1] and stored in 15 bits each
+constexpr uint32_t kPackedQuatMax = (1u << 15) - 1u;
+constexpr float kSqrtHalf = 0.70710678118654752f;
 
-    studiohdr_t stdhdr = {};
-    stream.ReadStruct(stdhdr);
+static HalfLifeModelPackedQuat PackQuat(const quatf& q) {
+    size_t largest = 0;
+    for (size_t i = 1; i < 4; ++i) {
+        if (FAbs(q[i]) > FAbs(q[largest])) {
+            largest = i;
+        }
+    }
 
-    if (HalfLifeModel::kIDSTMagic != stdhdr.magic || stdhdr.version < 10) {
-        return false;
+    const float scale = (q[largest] < 0.0f ? -1.0f : 1.0f) / kSqrtHalf;
+    uint64_t packed = largest;
+    for (size_t i = 0; i < 4; ++i) {
+        if (i != largest) {
+            const float value = Clamp(q[i] * scale, -1.0f, 1.0f);
+            packed = (packed << 15) | scast<uint64_t>((value * 0.5f + 0.5f) * scast<float>(kPackedQuatMax) + 0.5f);
+        }
     }
 
-    mSourcePath = filePath;
+    HalfLifeModelPackedQuat result;
+    result.words[0] = scast<uint16_t>(packed);
+    result.words[1] = scast<uint16_t>(packed >> 16);
+    result.words[2] = scast<uint16_t>(packed >> 32);
+    return result;
+}
 
-    if (stdhdr.numTextures == 0) {
-        // try to load texture model
-        fs::path tmodelPath = filePath;
-        tmodelPath.replace_extension("");
-        tmodelPath += "t.mdl";
-        MemStream tstream = ReadFileToMemStream(tmodelPath);
-        if (tstream) {
-            studiohdr_t stdhdr = {};
-            tstream.ReadStruct(stdhdr);
+static float UnpackQuatComponent(const uint64_t packed) {
+    return (scast<float>(scast<uint32_t>(packed) & kPackedQuatMax) * (2.0f / scast<float>(kPackedQuatMax)) - 1.0f) * kSqrtHalf;
+}
 
-            if (HalfLifeModel::kIDSTMagic == stdhdr.magic && stdhdr.numTextures) {
-                this->LoadTextures(tstream, scast<size_t>(stdhdr.numTextures), scast<size_t>(stdhdr.offsetTextures));
-                if (stdhdr.numSkinFamilies > 0) {
-                    this->LoadSkins(tstream, scast<size_t>(stdhdr.numSkinFamilies), scast<size_t>(stdhdr.numSkinRef), scast<size_t>(stdhdr.offsetSkins));
-                }
-            }
-        }
+static quatf UnpackQuat(const HalfLifeModelPackedQuat& packedQuat) {
+    const uint64_t packed = scast<uint64_t>(packedQuat.words[0]) | (scast<uint64_t>(packedQuat.words[1]) << 16) | (scast<uint64_t>(packedQuat.words[2]) << 32);
+    const float a = UnpackQuatComponent(packed >> 30);
+    const float b = UnpackQuatComponent(packed >> 15);
+    const float c = UnpackQuatComponent(packed);
+    const float largest = Sqrt(std::max(0.0f, 1.0f - a * a - b * b - c * c));
+
+    switch (packed >> 45) {
+        case 0:  return quatf(largest, a, b, c);
+        case 1:  return quatf(a, largest, b, c);
+        case 2:  return quatf(a, b, largest, c);
+        default: return quatf(a, b, c, largest);
     }
+}
 
-    stream.SetCursor(0);
-    bool result = this->LoadFromMemStream(stream, stdhdr);
+// three channels of a frame (offset or rotation) as they are applied to the bone
+static vec3f SampleAnimVector(const HalfLifeModelAnimChannel* channels, const uint32_t* words, const uint32_t frame, const vec3f& scale) {
+    return vec3f(scast<float>(SampleAnimChannel(channels[0], words, frame)) * scale.x,
+                 scast<float>(SampleAnimChannel(channels[1], words, frame)) * scale.y,
+                 scast<float>(SampleAnimChannel(channels[2], words, frame)) * scale.z);
+}
 
-    return result;
+static quatf SamplePackedRotation(const HalfLifeModelPackedQuat* rotations, const HalfLifeModelAnimLine& animLine, const uint32_t frame) {
+    return UnpackQuat(rotations[animLine.rotationOffset + ((animLine.rotationFrames > 1) ? frame : 0)]);
 }
 
-bool HalfLifeModel::LoadFromMemStream(MemStream& stream, const studiohdr_t& stdhdr) {
-    // need to load textures first to be able to calculate UVs
-    if (stdhdr.numTextures > 0) {
-        this->LoadTextures(stream, scast<size_t>(stdhdr.numTextures), scast<size_t>(stdhdr.offsetTextures));
-    }
-    if (stdhdr.numSkinFamilies > 0) {
-        this->LoadSkins(stream, scast<size_t>(stdhdr.numSkinFamilies), scast<size_t>(stdhdr.numSkinRef), scast<size_t>(stdhdr.offsetSkins));
-    }
+// whole frames around `frame` and how far it is from the first one
+static void SplitFrame(const float frame, const uint32_t numFrames, uint32_t& frameA, uint32_t& frameB, float& frameLerp) {
+    frameA = scast<uint32_t>(Floori(frame)) % numFrames;
+    frameB = (frameA + 1u) % numFrames;
+    frameLerp = frame - scast<float>(frameA);
+}
 
-    // load main geometry
-    mBodyParts.resize(stdhdr.numBodyParts);
-    mActiveBodyPartSubModel.resize(stdhdr.numBodyParts, 0);
-    MemStream bodypartsStream = stream.Substream(scast<size_t>(stdhdr.offsetBodyParts), stream.Length());
-    for (int bodyIdx = 0; bodyIdx < stdhdr.numBodyParts; ++bodyIdx) {
-        mBodyParts[bodyIdx] = MakeRefPtr<HalfLifeModelBodypart>();
-        BodyPartPtr& bodyPart = mBodyParts[bodyIdx];
+// cosine of the half angle between two rotations, about 11 degrees, nlerp is off by less than 0.01 degree below it
+constexpr float kNlerpMinCos = 0.995f;
 
-        mstudiobodyparts_t bparthdr = {};
-        bodypartsStream.ReadStruct(bparthdr);
+// nlerp is indistinguishable from slerp for close rotations, which neighbouring frames usually are
+static quatf BlendPrecomputedRotations(const quatf& a, const quatf& b, const float t) {
+    return (FAbs(quatf::dot(a, b)) >= kNlerpMinCos) ? quatf::nlerp(a, b, t) : quatf::slerp(a, b, t);
+}
 
-        bodyPart->SetName(bparthdr.name);
+// end of the memory DecodeAnimChannel touches for all channels of a sequence, walks the runs exactly the same way
+// returns nullptr if the data goes past `rangeEnd` (broken file)
+static const uint8_t* FindAnimDataEnd(const mstudioanim_t* anims, const size_t numBones, const uint32_t numFrames, const uint8_t* rangeEnd) {
+    const uint8_t* result = rcast<const uint8_t*>(anims + numBones);
 
-        MemStream modelsStream = stream.Substream(scast<size_t>(bparthdr.offsetModels), stream.Length());
-        for (int mdlIdx = 0; mdlIdx < bparthdr.numModels; ++mdlIdx) {
-            mstudiomodel_t mdlHdr = {};
-            modelsStream.ReadStruct(mdlHdr);
-
-            RefPtr<HalfLifeModelStudioModel> smdl = MakeRefPtr<HalfLifeModelStudioModel>();
-            smdl->SetName(mdlHdr.name);
-            smdl->SetType(mdlHdr.type);
-            smdl->SetBoundingRadius(mdlHdr.boundingRadius);
-
-            MyArray<vec3f> allModelVertices(mdlHdr.numVertices);
-            MyArray<vec3f> allModelNormals(mdlHdr.numNormals);
-            MyArray<uint8_t> allModelVBones(mdlHdr.numVertices);
-            MyArray<uint8_t> allModelNBones(mdlHdr.numNormals);
-
-            stream.Substream(mdlHdr.offsetVerices, stream.Length()).ReadToBuffer(allModelVertices.data(), sizeof(vec3f) * mdlHdr.numVertices);
-            stream.Substream(mdlHdr.offsetNormals, stream.Length()).ReadToBuffer(allModelNormals.data(), sizeof(vec3f) * mdlHdr.numNormals);
-            stream.Substream(mdlHdr.offsetVBonesIndices, stream.Length()).ReadToBuffer(allModelVBones.data(), allModelVBones.size());
-            stream.Substream(mdlHdr.offsetNBonesIndices, stream.Length()).ReadToBuffer(allModelNBones.data(), allModelNBones.size());
-
-            VertexIndexer indexer;
-
-            MemStream meshesStream = stream.Substream(scast<size_t>(mdlHdr.offsetMeshes), stream.Length());
-            uint32_t indicesOffset = 0;
-            for (int meshIdx = 0; meshIdx < mdlHdr.numMeshes; ++meshIdx) {
-                mstudiomesh_t meshHdr = {};
-                meshesStream.ReadStruct(meshHdr);
-
-                HalfLifeModelStudioMesh smesh;
-                smesh.textureIndex = scast<uint32_t>(meshHdr.skinref);
-
-                const HalfLifeModelTexture* hltexture = (smesh.textureIndex < mTextures.size()) ? &mTextures[smesh.textureIndex] : nullptr;
-
-                const float invTexWidth = (hltexture != nullptr) ? (1.0f / scast<float>(hltexture->width)) : 1.0f;
-                const float invTexHeight = (hltexture != nullptr) ? (1.0f / scast<float>(hltexture->height)) : 1.0f;
-
-                auto makeUV = [invTexWidth, invTexHeight](const HLVertexCMD& vcmd)->vec2f {
-                    return vec2f(scast<float>(vcmd.u) * invTexWidth, scast<float>(vcmd.v) * invTexHeight);
-                };
-
-                const int16_t* tricmds = rcast<const int16_t*>(stream.Data() + meshHdr.offsetTriangles);
-                int numVertices;
-                uint32_t numIndices = 0;
-                while (numVertices = *(tricmds++)) {
-                    if (numVertices < 0) {
-                        // this is a triangle fan, convert it to the striangles list
-                        numVertices = -numVertices;
-                        const HLVertexCMD* vertexCmds = rcast<const HLVertexCMD*>(tricmds);
-                        for (int i = 2; i < numVertices; ++i) {
-                            DebugAssert(allModelNBones[vertexCmds[0].normal] == allModelVBones[vertexCmds[0].vertex]);
-                            indexer.AddVertex(allModelVertices[vertexCmds[0].vertex], allModelNormals[vertexCmds[0].normal], makeUV(vertexCmds[0]), allModelVBones[vertexCmds[0].vertex]);
-
-                            DebugAssert(allModelNBones[vertexCmds[i].normal] == allModelVBones[vertexCmds[i].vertex]);
-                            indexer.AddVertex(allModelVertices[vertexCmds[i].vertex], allModelNormals[vertexCmds[i].normal], makeUV(vertexCmds[i]), allModelVBones[vertexCmds[i].vertex]);
-
-                            DebugAssert(allModelNBones[vertexCmds[i-1].normal] == allModelVBones[vertexCmds[i-1].vertex]);
-                            indexer.AddVertex(allModelVertices[vertexCmds[i-1].vertex], allModelNormals[vertexCmds[i-1].normal], makeUV(vertexCmds[i-1]), allModelVBones[vertexCmds[i-1].vertex]);
-                        }
+    auto touch = [&result, rangeEnd](const mstudioanimvalue_t* ptr)->bool {
+        const uint8_t* touchEnd = rcast<const uint8_t*>(ptr + 1);
+        result = std::max(result, touchEnd);
+        return touchEnd <= rangeEnd;
+    };
 
-                        tricmds += numVertices * 4;
-                        numIndices += scast<uint32_t>((numVertices - 2) * 3);
-                    } else {
-                        // this is a triangle strip, convert it to the striangles list
-                        const HLVertexCMD* vertexCmds = rcast<const HLVertexCMD*>(tricmds);
-                        for (int i = 0; i < numVertices - 2; ++i) {
-                            DebugAssert(allModelNBones[vertexCmds[i].normal] == allModelVBones[vertexCmds[i].vertex]);
-                            indexer.AddVertex(allModelVertices[vertexCmds[i].vertex], allModelNormals[vertexCmds[i].normal], makeUV(vertexCmds[i]), allModelVBones[vertexCmds[i].vertex]);
-
-                            if (i & 1) {
-                                DebugAssert(allModelNBones[vertexCmds[i+1].normal] == allModelVBones[vertexCmds[i+1].vertex]);
-                                indexer.AddVertex(allModelVertices[vertexCmds[i+1].vertex], allModelNormals[vertexCmds[i+1].normal], makeUV(vertexCmds[i+1]), allModelVBones[vertexCmds[i+1].vertex]);
-
-                                DebugAssert(allModelNBones[vertexCmds[i+2].normal] == allModelVBones[vertexCmds[i+2].vertex]);
-                                indexer.AddVertex(allModelVertices[vertexCmds[i+2].vertex], allModelNormals[vertexCmds[i+2].normal], makeUV(vertexCmds[i+2]), allModelVBones[vertexCmds[i+2].vertex]);
-                            } else {
-                                DebugAssert(allModelNBones[vertexCmds[i+2].normal] == allModelVBones[vertexCmds[i+2].vertex]);
-                                indexer.AddVertex(allModelVertices[vertexCmds[i+2].vertex], allModelNormals[vertexCmds[i+2].normal], makeUV(vertexCmds[i+2]), allModelVBones[vertexCmds[i+2].vertex]);
-
-                                DebugAssert(allModelNBones[vertexCmds[i+1].normal] == allModelVBones[vertexCmds[i+1].vertex]);
-                                indexer.AddVertex(allModelVertices[vertexCmds[i+1].vertex], allModelNormals[vertexCmds[i+1].normal], makeUV(vertexCmds[i+1]), allModelVBones[vertexCmds[i+1].vertex]);
-                            }
-                        }
+    for (size_t boneIdx = 0; boneIdx < numBones; ++boneIdx) {
+        const mstudioanim_t* animPtr = anims + boneIdx;
+        for (size_t channel = 0; channel < kAnimFrameStride; ++channel) {
+            if (!animPtr->offset[channel]) {
+                continue;
+            }
+
+            const mstudioanimvalue_t* valuePtr = rcast<const mstudioanimvalue_t*>(rcast<const char*>(animPtr) + animPtr->offset[channel]);
+            if (!touch(valuePtr)) {
+                return nullptr;
+            }
 
-                        tricmds += numVertices * 4;
-                        numIndices += scast<uint32_t>((numVertices - 2) * 3);
+            int runFrame = 0;
+            for (uint32_t frame = 0; frame < numFrames; ++frame, ++runFrame) {
+                bool endOfData = false;
+                while (valuePtr->num.total <= runFrame) {
+                    runFrame -= valuePtr->num.total;
+                    valuePtr += valuePtr->num.valid + 1;
+                    if (!touch(valuePtr)) {
+                        return nullptr;
+                    }
+                    if (!valuePtr->num.total) {
+                        endOfData = true;
+                        break;
                     }
                 }
 
-                smesh.numIndices = numIndices;
-                smesh.indicesOffset = indicesOffset;
+                if (endOfData) {
+                    break;
+                }
+                if (!touch(valuePtr + std::min<int>(valuePtr->num.valid, runFrame + 1))) {
+                    return nullptr;
+                }
+            }
+        }
+    }
 
-                indicesOffset += numIndices;
+    return result;
+}
 
-                smdl->AddMesh(smesh);
-            }
 
-            smdl->SetVertices(indexer.vertices);
-            smdl->SetIndices(indexer.indices);
+// on-disk cache of the post-processed model (.hlmvcache)
+// sections go in the order LoadFromCache reads them, bulk arrays are aligned and used right from the mapped file
+// sequences keep their raw RLE blocks (relative offsets survive a plain copy), so lazy decoding works the same way
+constexpr uint32_t kCacheMagic = MakeFourcc<'H','L','M','C'>();
+constexpr uint32_t kCacheVersion = 3;
+constexpr size_t kCacheAlignment = 16;
+// some structures are dumped as is, any change of their size invalidates the cache
+constexpr uint64_t kCacheLayout = scast<uint64_t>(sizeof(HalfLifeModelVertex)) |
+                                  (scast<uint64_t>(sizeof(HalfLifeModelStudioMesh)) << 8) |
+                                  (scast<uint64_t>(sizeof(HalfLifeModelBoneController)) << 16) |
+                                  (scast<uint64_t>(sizeof(HalfLifeModelHitBox)) << 24) |
+                                  (scast<uint64_t>(sizeof(vec3f)) << 32) |
+                                  (scast<uint64_t>(sizeof(AABBox)) << 40) |
+                                  (scast<uint64_t>(sizeof(mstudioanim_t)) << 48);
+
+struct HLCacheHeader {
+    uint32_t    magic;
+    uint32_t    version;
+    uint64_t    layout;
+    uint64_t    payloadSize;
+    uint64_t    payloadHash;    // everything after the header, catches truncated and damaged files
+};
 
-            mBounds.Absorb(indexer.bounds);
+// a source file the cached model was built from, missing files are tracked too as they can show up later
+struct HLCacheDependency {
+    CharString  fileName;       // relative to the model folder
+    bool        present;
+    uint64_t    size;
+    int64_t     mtime;
+    uint64_t    contentHash;
+};
 
-            bodyPart->AddStudioModel(smdl);
-        }
+static bool StatCacheDependency(const fs::path& filePath, HLCacheDependency& dep) {
+    VFSFileInfo info = {};
+    if (!VirtualFileSystem::GetFileInfo(filePath, info)) {
+        return false;
     }
+    dep.size = info.size;
+    dep.mtime = info.mtime;
+    return true;
+}
 
-    // load bones
-    if (stdhdr.numBones > 0) {
-        mBones.resize(stdhdr.numBones);
-        mSkeleton.resize(stdhdr.numBones);
-
-        MemStream bonesStream = stream.Substream(scast<size_t>(stdhdr.offsetBones), stream.Length());
-        for (int i = 0; i < stdhdr.numBones; ++i) {
-            mstudiobone_t sbone = {};
-            bonesStream.ReadStruct(sbone);
+static uint64_t HashFileContent(const fs::path& filePath) {
+    MemStream content = VirtualFileSystem::ReadFile(filePath);
+    return HashBytes(content.Data(), content.Length());
+}
 
-            HalfLifeModelBone& hlbone = mBones[i];
-            hlbone.name = sbone.name;
-            hlbone.parentIdx = sbone.parent;
-            hlbone.pos = vec3f(sbone.value[0], sbone.value[1], sbone.value[2]);
-            hlbone.rot = vec3f(sbone.value[3], sbone.value[4], sbone.value[5]);
-            hlbone.scalePos = vec3f(sbone.scale[0], sbone.scale[1], sbone.scale[2]);
-            hlbone.scaleRot = vec3f(sbone.scale[3], sbone.scale[4], sbone.scale[5]);
-            memcpy(hlbone.controllerIdx, sbone.bonecontroller, sizeof(hlbone.controllerIdx));
+// `content` is the file as the load already read it, the file is read again only if that's not at hand
+static HLCacheDependency DescribeCacheDependency(const fs::path& folder, const CharString& fileName, const MemStream& content) {
+    HLCacheDependency dep = {};
+    dep.fileName = fileName;
 
-            mSkeleton[i] = mat4f::identity();
-        }
+    const fs::path filePath = folder / fs::u8path(fileName);
+    dep.present = StatCacheDependency(filePath, dep);
+    if (dep.present) {
+        dep.contentHash = (content && content.Length() == dep.size) ? HashBytes(content.Data(), content.Length()) : HashFileContent(filePath);
     }
+    return dep;
+}
 
-    // load bone controllers
-    if (stdhdr.numBoneControllers > 0) {
-        mBoneControllers.resize(stdhdr.numBoneControllers);
-        mBoneControllerValues.resize(stdhdr.numBoneControllers);
+// same size and mtime is up to date, the content is hashed only if just the mtime changed (the file was copied or touched)
+static bool IsCacheDependencyUpToDate(const fs::path& folder, const HLCacheDependency& cached) {
+    const fs::path filePath = folder / fs::u8path(cached.fileName);
 
-        MemStream bctrlsStream = stream.Substream(scast<size_t>(stdhdr.offsetBoneControllers), stream.Length());
-        for (int i = 0; i < stdhdr.numBoneControllers; ++i) {
-            mstudiobonecontroller_t hlbcontroller = {};
-            bctrlsStream.ReadStruct(hlbcontroller);
+    HLCacheDependency current = {};
+    current.present = StatCacheDependency(filePath, current);
+    if (current.present != cached.present) {
+        return false;
+    }
+    if (!current.present) {
+        return true;
+    }
 
-            HalfLifeModelBoneController& bcontroller = mBoneControllers[i];
-            bcontroller.boneIdx = hlbcontroller.bone;
-            bcontroller.type = scast<uint32_t>(hlbcontroller.type);
-            bcontroller.start = hlbcontroller.start;
-            bcontroller.end = hlbcontroller.end;
-            bcontroller.index = scast<uint32_t>(hlbcontroller.index);
+    if (current.size != cached.size) {
+        return false;
+    }
+    return current.mtime == cached.mtime || HashFileContent(filePath) == cached.contentHash;
+}
 
-            mBoneControllerValues[i] = 0.0f;
-        }
+static CharString FormatHex64(uint64_t value) {
+    static const char kHexDigits[] = "0123456789abcdef";
+    CharString result(16, '0');
+    for (size_t i = 0; i < 16; ++i, value >>= 4) {
+        result[15 - i] = kHexDigits[value & 0xF];
     }
+    return result;
+}
 
-    MyArray<MemStream> seqGroupsFiles;
+// every writer gets its own temporary file, threads and processes sharing the cache folder never clobber each other's
+static fs::path MakeCacheTempPath(const fs::path& cachePath) {
+#ifdef _WIN32
+    const int processId = _getpid();
+#else
+    const int processId = scast<int>(getpid());
+#endif
+    const uint64_t threadHash = scast<uint64_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
 
-    fs::path sourceFolder = mSourcePath.parent_path();
-    // load sequences groups
-    if (stdhdr.numSeqGroups > 0) {
-        if (stdhdr.numSeqGroups > 1) {
-            seqGroupsFiles.resize(stdhdr.numSeqGroups - 1);
-        }
+    fs::path result = cachePath;
+    result += "." + std::to_string(processId) + "-" + FormatHex64(threadHash) + ".tmp";
+    return result;
+}
 
-        mSequenceGroups.resize(stdhdr.numSeqGroups);
+// temporary files older than this are left behind by crashed writers
+constexpr std::chrono::hours kStaleCacheTempAge(1);
 
-        MemStream seqGrpsStream = stream.Substream(scast<size_t>(stdhdr.offsetSeqGroups), stream.Length());
-        for (int i = 0; i < stdhdr.numSeqGroups; ++i) {
-            HalfLifeModelSequenceGroup& seqGrp = mSequenceGroups[i];
+// deletes the least recently used cache files until the folder fits into `budget` (0 - no limit), `keep` is never deleted
+// cache files are touched on every hit, so their modification time is the last use
+static void TrimCacheFolder(const fs::path& folder, const size_t budget, const fs::path& keep) {
+    struct CacheFile {
+        fs::path            path;
+        uintmax_t           size;
+        fs::file_time_type  lastUse;
+    };
 
-            mstudioseqgroup_t hlSeqGrp = {};
-            seqGrpsStream.ReadStruct(hlSeqGrp);
+    MyArray<CacheFile> files;
+    uintmax_t totalSize = 0;
+    const fs::file_time_type staleTime = fs::file_time_type::clock::now() - kStaleCacheTempAge;
 
-            seqGrp.label = hlSeqGrp.label;
-            seqGrp.name = hlSeqGrp.name;
-            seqGrp.data = hlSeqGrp.data;
+    std::error_code ec;
+    for (fs::directory_iterator it(folder, ec), end; !ec && it != end; it.increment(ec)) {
+        std::error_code entryEc;
+        if (!it->is_regular_file(entryEc)) {
+            continue;
+        }
+        CacheFile file = { it->path(), 0, {} };
+        file.size = it->file_size(entryEc);
+        if (entryEc) {
+            continue;
+        }
+        file.lastUse = it->last_write_time(entryEc);
+        if (entryEc) {
+            continue;
+        }
 
-            if (i > 0) {
-                fs::path seqGroupFileName = fs::path(seqGrp.name).filename();
-                MemStream seqStream = ReadFileToMemStream(sourceFolder / seqGroupFileName);
-                if (seqStream) {
-                    studiohdr_t seqStdhdr = {};
-                    seqStream.ReadStruct(seqStdhdr);
-                    if (HalfLifeModel::kIDSQMagic == seqStdhdr.magic) {
-                        seqGroupsFiles[i - 1] = seqStream;
-                    }
-                }
+        if (file.path.extension() == ".tmp") {
+            if (file.lastUse < staleTime) {
+                fs::remove(file.path, entryEc);
             }
+        } else if (file.path.extension() == ".hlmvcache") {
+            totalSize += file.size;
+            files.push_back(file);
         }
     }
 
-    // load sequences
-    if (stdhdr.numSequences > 0) {
-        mSequences.resize(stdhdr.numSequences);
+    if (!budget || totalSize <= budget) {
+        return;
+    }
 
-        MemStream seqStream = stream.Substream(scast<size_t>(stdhdr.offsetSequences), stream.Length());
-        for (size_t i = 0; i < mSequences.size(); ++i) {
-            SequencePtr& sequence = mSequences[i];
+    std::sort(files.begin(), files.end(), [](const CacheFile& a, const CacheFile& b) {
+        return a.lastUse < b.lastUse;
+    });
+    for (const CacheFile& file : files) {
+        if (totalSize <= budget) {
+            break;
+        }
+        if (file.path != keep && fs::remove(file.path, ec)) {
+            totalSize -= file.size;
+        }
+    }
+}
 
-            mstudioseqdesc_t seqDesc = {};
-            seqStream.ReadStruct(seqDesc);
+static void WriteCacheString(MemWriteStream& stream, const StringView& str) {
+    stream.WriteU32(scast<uint32_t>(str.size()));
+    stream.Write(str.data(), str.size());
+}
+
+// the string stays in the cache file memory, which the model keeps alive
+static StringView ReadCacheString(MemStream& stream) {
+    const uint32_t length = stream.ReadU32();
+    const ArrayView<char> chars = stream.GetView<char>(stream.GetCursor(), length);
+    stream.SkipBytes(chars.size());
+    return StringView(chars.data(), chars.size());
+}
+
+template <typename T>
+static void WriteCacheArray(MemWriteStream& stream, const T* data, const size_t count) {
+    stream.WriteU64(scast<uint64_t>(count));
+    stream.Align(kCacheAlignment);
+    stream.Write(data, count * sizeof(T));
+}
+
+template <typename T>
+static bool ReadCacheArray(MemStream& stream, ArrayView<T>& view) {
+    const size_t count = scast<size_t>(stream.ReadU64());
+    stream.SetCursor((stream.GetCursor() + kCacheAlignment - 1) & ~(kCacheAlignment - 1));
+    view = stream.GetView<T>(stream.GetCursor(), count);
+    stream.SkipBytes(view.size() * sizeof(T));
+    return view.size() == count;
+}
+
+
+HalfLifeModel::HalfLifeModel()
+    : mAnimState(MakeStrongPtr<SequencesAnimState>())
+{
+}
+HalfLifeModel::~HalfLifeModel() {
+}
+
+void HalfLifeModel::SetLoadOptions(const HalfLifeModelLoadOptions& options) {
+    mLoadOptions = options;
+}
+
+const HalfLifeModelLoadOptions& HalfLifeModel::GetLoadOptions() const {
+    return mLoadOptions;
+}
+
+const HalfLifeModelLoadStats& HalfLifeModel::GetLoadStats() const {
+    return mLoadStats;
+}
+
+bool HalfLifeModel::IsCompanionFile(const fs::path& filePath) {
+    const CharString stem = filePath.stem().u8string();
+    const size_t len = stem.length();
+    const fs::path folder = filePath.parent_path();
+    const CharString ext = filePath.extension().u8string();
+
+    if (len > 1 && (stem[len - 1] == 't' || stem[len - 1] == 'T')) {
+        if (VirtualFileSystem::Exists(folder / fs::u8path(stem.substr(0, len - 1) + ext))) {
+            return true;
+        }
+    }
+    if (len > 2 && std::isdigit(scast<unsigned char>(stem[len - 1])) && std::isdigit(scast<unsigned char>(stem[len - 2]))) {
+        if (VirtualFileSystem::Exists(folder / fs::u8path(stem.substr(0, len - 2) + ext))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HalfLifeModel::ScanInfo(const fs::path& filePath, HalfLifeModelInfo& info) {
+    const MemStream stream = VirtualFileSystem::ReadFile(filePath);
+    const ArrayView<studiohdr_t> header = stream.GetView<studiohdr_t>(0, 1);
+    if (header.empty() || HalfLifeModel::kIDSTMagic != header[0].magic || header[0].version < 10) {
+        return false;
+    }
+    const studiohdr_t& stdhdr = header[0];
+
+    info = {};
+    info.name = ScanName(stdhdr.name);
+    info.version = scast<uint32_t>(stdhdr.version);
+    info.flags = scast<uint32_t>(stdhdr.flags);
+    info.bounds = AABBox(stdhdr.bbmin, stdhdr.bbmax);
+    info.numAttachments = scast<size_t>(std::max(0, stdhdr.numAttachments));
+    info.numHitBoxes = scast<size_t>(std::max(0, stdhdr.numHitBoxes));
+
+    const ArrayView<mstudiobone_t> bones = ScanTable<mstudiobone_t>(stream, stdhdr.offsetBones, stdhdr.numBones);
+    info.bones.reserve(bones.size());
+    for (const mstudiobone_t& bone : bones) {
+        info.bones.push_back(ScanName(bone.name));
+    }
+
+    const ArrayView<mstudiobodyparts_t> bodyParts = ScanTable<mstudiobodyparts_t>(stream, stdhdr.offsetBodyParts, stdhdr.numBodyParts);
+    info.bodyParts.resize(bodyParts.size());
+    for (size_t i = 0; i < bodyParts.size(); ++i) {
+        HalfLifeModelInfoBodypart& bodyPart = info.bodyParts[i];
+        bodyPart.name = ScanName(bodyParts[i].name);
+
+        const ArrayView<mstudiomodel_t> models = ScanTable<mstudiomodel_t>(stream, bodyParts[i].offsetModels, bodyParts[i].numModels);
+        bodyPart.subModels.reserve(models.size());
+        for (const mstudiomodel_t& model : models) {
+            bodyPart.subModels.push_back(ScanName(model.name));
+        }
+    }
+
+    const ArrayView<mstudioseqdesc_t> sequences = ScanTable<mstudioseqdesc_t>(stream, stdhdr.offsetSequences, stdhdr.numSequences);
+    info.sequences.resize(sequences.size());
+    for (size_t i = 0; i < sequences.size(); ++i) {
+        HalfLifeModelInfoSequence& sequence = info.sequences[i];
+        sequence.name = ScanName(sequences[i].label);
+        sequence.fps = sequences[i].fps;
+        sequence.numFrames = scast<uint32_t>(sequences[i].numFrames);
+        sequence.sequenceGroup = scast<uint32_t>(sequences[i].seqGroup);
+    }
+
+    const ArrayView<mstudioseqgroup_t> seqGroups = ScanTable<mstudioseqgroup_t>(stream, stdhdr.offsetSeqGroups, stdhdr.numSeqGroups);
+    info.sequenceGroups.reserve(seqGroups.size());
+    for (const mstudioseqgroup_t& seqGroup : seqGroups) {
+        info.sequenceGroups.push_back(ScanName(seqGroup.name));
+    }
+
+    if (stdhdr.numTextures > 0) {
+        ScanTexturesInfo(stream, stdhdr, info);
+    } else {
+        // same as the loader, textures live in the textures file then
+        fs::path tmodelPath = filePath;
+        tmodelPath.replace_extension("");
+        tmodelPath += "t.mdl";
+
+        const MemStream tstream = VirtualFileSystem::ReadFile(tmodelPath);
+        const ArrayView<studiohdr_t> theader = tstream.GetView<studiohdr_t>(0, 1);
+        if (!theader.empty() && HalfLifeModel::kIDSTMagic == theader[0].magic) {
+            ScanTexturesInfo(tstream, theader[0], info);
+        }
+    }
+
+    return true;
+}
+
+bool HalfLifeModel::LoadFromPath(const fs::path& filePath) {
+    const LoadClock::time_point loadStart = LoadClock::now();
+
+    mLoadStats = {};
+
+    const fs::path cachePath = mLoadOptions.cacheDir.empty() ? fs::path() : this->GetCachePath(filePath);
+    if (!cachePath.empty()) {
+        mSourcePath = filePath;
+        const bool cacheHit = this->LoadFromCache(cachePath);
+        const float cacheMs = MillisecondsSince(loadStart);
+        if (cacheHit) {
+            mLoadStats.fromCache = true;
+            mLoadStats.cacheMs = cacheMs - mLoadStats.decodeMs;
+            mLoadStats.sequencesMs = mLoadStats.decodeMs;
+            mLoadStats.totalMs = cacheMs;
+            return this->ReportLoadProgress(1.0f);
+        }
+
+        // missing, stale or broken cache, start over from the sources and write a fresh one
+        const HalfLifeModelLoadOptions options = mLoadOptions;
+        *this = HalfLifeModel();
+        mLoadOptions = options;
+        mLoadStats.cacheMs = cacheMs;
+    }
+
+    MemStream stream = VirtualFileSystem::ReadFile(filePath);
+    if (!stream) {
+        return false;
+    }
+
+    studiohdr_t stdhdr = {};
+    stream.ReadStruct(stdhdr);
+
+    if (HalfLifeModel::kIDSTMagic != stdhdr.magic || stdhdr.version < 10) {
+        return false;
+    }
+
+    mSourcePath = filePath;
+
+    // the header names all the other files we need, so start reading them all at once,
+    // meanwhile the rest of the main file is read ahead and the parsing only waits for what it needs next
+    if (mLoadOptions.concurrentReads) {
+        VirtualFileSystem::Prefetch(stream);
+    }
+
+    std::future<MemStream> tmodelRead;
+    if (stdhdr.numTextures == 0) {
+        // try to load texture model
+        fs::path tmodelPath = filePath;
+        tmodelPath.replace_extension("");
+        tmodelPath += "t.mdl";
+        tmodelRead = ReadFileAsync(tmodelPath, mLoadOptions.concurrentReads);
+    }
+
+    this->StartSequenceGroupsReads(stream, stdhdr);
+
+    if (tmodelRead.valid()) {
+        MemStream tstream = tmodelRead.get();
+        if (tstream) {
+            studiohdr_t stdhdr = {};
+            tstream.ReadStruct(stdhdr);
+
+            if (HalfLifeModel::kIDSTMagic == stdhdr.magic && stdhdr.numTextures) {
+                const LoadClock::time_point texturesStart = LoadClock::now();
+                mTexturesStream = tstream;
+                this->LoadTextures(mTexturesStream, scast<size_t>(stdhdr.numTextures), scast<size_t>(stdhdr.offsetTextures));
+                if (stdhdr.numSkinFamilies > 0) {
+                    this->LoadSkins(mTexturesStream, scast<size_t>(stdhdr.numSkinFamilies), scast<size_t>(stdhdr.numSkinRef), scast<size_t>(stdhdr.offsetSkins));
+                }
+                mLoadStats.texturesMs += MillisecondsSince(texturesStart);
+            }
+        }
+    }
+
+    // LoadFromMemStream adds its own parts, everything else here is files reading
+    mLoadStats.readMs = MillisecondsSince(loadStart) - mLoadStats.texturesMs - mLoadStats.cacheMs;
+
+    if (!this->ReportLoadProgress(0.1f)) {
+        return false;
+    }
+
+    stream.SetCursor(0);
+    bool result = this->LoadFromMemStream(stream, stdhdr);
+    mSeqGroupsReads.clear();
+
+    if (result && !cachePath.empty()) {
+        const LoadClock::time_point cacheStart = LoadClock::now();
+        this->SaveToCache(cachePath);
+        mLoadStats.cacheMs += MillisecondsSince(cacheStart);
+    }
+
+    mLoadStats.totalMs = MillisecondsSince(loadStart);
+
+    return result && this->ReportLoadProgress(1.0f);
+}
+
+bool HalfLifeModel::LoadFromMemStream(MemStream& srcStream, const studiohdr_t& stdhdr) {
+    // we keep views into the model memory, so make sure we own it
+    mModelStream = srcStream.Clone();
+    mModelStream.SetCursor(srcStream.GetCursor());
+    MemStream& stream = mModelStream;
+
+    LoadClock::time_point stageStart = LoadClock::now();
+
+    // need to load textures first to be able to calculate UVs
+    if (stdhdr.numTextures > 0) {
+        this->LoadTextures(stream, scast<size_t>(stdhdr.numTextures), scast<size_t>(stdhdr.offsetTextures));
+    }
+    if (stdhdr.numSkinFamilies > 0) {
+        this->LoadSkins(stream, scast<size_t>(stdhdr.numSkinFamilies), scast<size_t>(stdhdr.numSkinRef), scast<size_t>(stdhdr.offsetSkins));
+    }
+
+    mLoadStats.texturesMs += MillisecondsSince(stageStart);
+    if (!this->ReportLoadProgress(0.2f)) {
+        return false;
+    }
+    stageStart = LoadClock::now();
+
+    // load main geometry
+    // read all the headers first, then expand submodels in parallel and gather the results in the original order
+    struct StudioModelJob {
+        mstudiomodel_t              mdlHdr;
+        HalfLifeModelStudioModel*   smdl;
+        AABBox                      bounds;
+        VertexCacheStats            vcacheStats;
+        bool                        valid;
+    };
+    MyArray<StudioModelJob> studioModelJobs;
+
+    mBodyParts.resize(stdhdr.numBodyParts);
+    MemStream bodypartsStream = stream.Substream(scast<size_t>(stdhdr.offsetBodyParts), stream.Length());
+    for (int bodyIdx = 0; bodyIdx < stdhdr.numBodyParts; ++bodyIdx) {
+        mBodyParts[bodyIdx] = mArena.New<HalfLifeModelBodypart>();
+        BodyPartPtr& bodyPart = mBodyParts[bodyIdx];
+
+        mstudiobodyparts_t bparthdr = {};
+        bodypartsStream.ReadStruct(bparthdr);
+
+        bodyPart->SetName(mArena.CopyString(bparthdr.name, sizeof(bparthdr.name)));
+
+        const size_t numModels = scast<size_t>(std::max(0, bparthdr.numModels));
+        HalfLifeModelStudioModel** models = mArena.AllocArray<HalfLifeModelStudioModel*>(numModels);
+
+        MemStream modelsStream = stream.Substream(scast<size_t>(bparthdr.offsetModels), stream.Length());
+        for (size_t mdlIdx = 0; mdlIdx < numModels; ++mdlIdx) {
+            StudioModelJob job = {};
+            modelsStream.ReadStruct(job.mdlHdr);
+
+            job.smdl = mArena.New<HalfLifeModelStudioModel>();
+            job.smdl->SetName(mArena.CopyString(job.mdlHdr.name, sizeof(job.mdlHdr.name)));
+            job.smdl->SetType(job.mdlHdr.type);
+            job.smdl->SetBoundingRadius(job.mdlHdr.boundingRadius);
+
+            models[mdlIdx] = job.smdl;
+            studioModelJobs.push_back(job);
+        }
+
+        bodyPart->SetStudioModels(ArrayView<HalfLifeModelStudioModel*>(models, numModels));
+    }
+
+    ParallelFor(studioModelJobs.size(), mLoadOptions.numThreads, [this, &stream, &studioModelJobs](const size_t jobIdx) {
+        StudioModelJob& job = studioModelJobs[jobIdx];
+        job.valid = this->LoadStudioModel(stream, job.mdlHdr, *job.smdl, job.bounds, job.vcacheStats);
+    });
+
+    size_t numTriangles = 0, missesBefore = 0, missesAfter = 0;
+    for (const StudioModelJob& job : studioModelJobs) {
+        if (job.valid) {
+            mBounds.Absorb(job.bounds);
+            numTriangles += job.vcacheStats.numTriangles;
+            missesBefore += job.vcacheStats.missesBefore;
+            missesAfter += job.vcacheStats.missesAfter;
+        }
+    }
+    if (numTriangles) {
+        mLoadStats.acmrBefore = scast<float>(missesBefore) / scast<float>(numTriangles);
+        mLoadStats.acmrAfter = scast<float>(missesAfter) / scast<float>(numTriangles);
+    }
+
+    mLoadStats.geometryMs = MillisecondsSince(stageStart);
+    if (!this->ReportLoadProgress(0.6f)) {
+        return false;
+    }
+
+    // load bones
+    if (stdhdr.numBones > 0) {
+        mBones.resize(stdhdr.numBones);
+
+        MemStream bonesStream = stream.Substream(scast<size_t>(stdhdr.offsetBones), stream.Length());
+        for (int i = 0; i < stdhdr.numBones; ++i) {
+            mstudiobone_t sbone = {};
+            bonesStream.ReadStruct(sbone);
+
+            HalfLifeModelBone& hlbone = mBones[i];
+            hlbone.name = mArena.CopyString(sbone.name, sizeof(sbone.name));
+            hlbone.parentIdx = sbone.parent;
+            hlbone.pos = vec3f(sbone.value[0], sbone.value[1], sbone.value[2]);
+            hlbone.rot = vec3f(sbone.value[3], sbone.value[4], sbone.value[5]);
+            hlbone.scalePos = vec3f(sbone.scale[0], sbone.scale[1], sbone.scale[2]);
+            hlbone.scaleRot = vec3f(sbone.scale[3], sbone.scale[4], sbone.scale[5]);
+            memcpy(hlbone.controllerIdx, sbone.bonecontroller, sizeof(hlbone.controllerIdx));
+        }
+    }
+
+    // load bone controllers
+    if (stdhdr.numBoneControllers > 0) {
+        mBoneControllers.resize(stdhdr.numBoneControllers);
+
+        MemStream bctrlsStream = stream.Substream(scast<size_t>(stdhdr.offsetBoneControllers), stream.Length());
+        for (int i = 0; i < stdhdr.numBoneControllers; ++i) {
+            mstudiobonecontroller_t hlbcontroller = {};
+            bctrlsStream.ReadStruct(hlbcontroller);
+
+            HalfLifeModelBoneController& bcontroller = mBoneControllers[i];
+            bcontroller.boneIdx = hlbcontroller.bone;
+            bcontroller.type = scast<uint32_t>(hlbcontroller.type);
+            bcontroller.start = hlbcontroller.start;
+            bcontroller.end = hlbcontroller.end;
+            bcontroller.index = scast<uint32_t>(hlbcontroller.index);
+        }
+    }
+
+    if (!this->ReportLoadProgress(0.65f)) {
+        return false;
+    }
+    stageStart = LoadClock::now();
+
+    MyArray<MemStream> seqGroupsFiles;
+
+    // load sequences groups
+    if (stdhdr.numSeqGroups > 0) {
+        if (stdhdr.numSeqGroups > 1) {
+            seqGroupsFiles.resize(stdhdr.numSeqGroups - 1);
+        }
+
+        mSequenceGroups.resize(stdhdr.numSeqGroups);
+        mAnimState->groupsMissing.resize(stdhdr.numSeqGroups, false);
+
+        MemStream seqGrpsStream = stream.Substream(scast<size_t>(stdhdr.offsetSeqGroups), stream.Length());
+        for (int i = 0; i < stdhdr.numSeqGroups; ++i) {
+            HalfLifeModelSequenceGroup& seqGrp = mSequenceGroups[i];
+
+            mstudioseqgroup_t hlSeqGrp = {};
+            seqGrpsStream.ReadStruct(hlSeqGrp);
+
+            seqGrp.label = mArena.CopyString(hlSeqGrp.label, sizeof(hlSeqGrp.label));
+            seqGrp.name = mArena.CopyString(hlSeqGrp.name, sizeof(hlSeqGrp.name));
+            seqGrp.data = hlSeqGrp.data;
+
+            // in lazy mode external groups are demand loaded, see TouchSequenceAnim
+            if (i > 0 && !mLoadOptions.lazySequences) {
+                seqGroupsFiles[i - 1] = this->TakeSequenceGroupFile(scast<size_t>(i));
+            }
+        }
+    }
+
+    // load sequences
+    if (stdhdr.numSequences > 0) {
+        mSequences.resize(stdhdr.numSequences);
+        mAnimState->lastUse = MakeStrongPtr<std::atomic<uint64_t>[]>(mSequences.size());
+        mAnimState->bakeLastUse = MakeStrongPtr<std::atomic<uint64_t>[]>(mSequences.size());
+        mAnimState->bakeRejected.resize(mSequences.size(), false);
+        mSequencesAnimOffset.resize(stdhdr.numSequences, 0);
 
-            sequence = MakeRefPtr<HalfLifeModelSequence>(mBones.size());
-            sequence->SetName(seqDesc.label);
+        MemStream seqStream = stream.Substream(scast<size_t>(stdhdr.offsetSequences), stream.Length());
+        for (size_t i = 0; i < mSequences.size(); ++i) {
+            SequencePtr& sequence = mSequences[i];
+
+            mstudioseqdesc_t seqDesc = {};
+            seqStream.ReadStruct(seqDesc);
+
+            sequence = mArena.New<HalfLifeModelSequence>(mArena, ArrayView<HalfLifeModelBone>(mBones.data(), mBones.size()),
+                                                         ArrayView<HalfLifeModelBoneController>(mBoneControllers.data(), mBoneControllers.size()), mLoadOptions.precomputeRotations);
+            sequence->SetName(mArena.CopyString(seqDesc.label, sizeof(seqDesc.label)));
             sequence->SetFPS(seqDesc.fps);
             sequence->SetMotionType(scast<uint32_t>(seqDesc.motionType));
             sequence->SetMotionBone(scast<uint32_t>(seqDesc.motionBone));
@@ -356,35 +1156,48 @@ bool HalfLifeModel::LoadFromMemStream(MemStream& stream, const studiohdr_t& stdh
             sequence->SetFramesCount(scast<uint32_t>(seqDesc.numFrames));
             sequence->SetBounds(AABBox(seqDesc.bbmin, seqDesc.bbmax));
 
+            mSequencesAnimOffset[i] = scast<size_t>(seqDesc.offsetAnimData);
+
             // first sequence group is always built-in it seems
             if (!seqDesc.seqGroup) {
                 this->LoadSequenceAnim(sequence, stream, scast<size_t>(seqDesc.offsetAnimData + mSequenceGroups[0].data));
-            } else if (seqGroupsFiles[seqDesc.seqGroup - 1]) {
+            } else if (scast<size_t>(seqDesc.seqGroup) <= seqGroupsFiles.size() && seqGroupsFiles[seqDesc.seqGroup - 1]) {
                 this->LoadSequenceAnim(sequence, seqGroupsFiles[seqDesc.seqGroup - 1], scast<size_t>(seqDesc.offsetAnimData));
             }
 
             if (seqDesc.numEvents > 0) {
-                MyArray<HalfLifeModelAnimEvent> events(seqDesc.numEvents);
+                const size_t numEvents = scast<size_t>(seqDesc.numEvents);
+                HalfLifeModelAnimEvent* events = mArena.AllocArray<HalfLifeModelAnimEvent>(numEvents);
                 MemStream eventsStream = stream.Substream(scast<size_t>(seqDesc.offsetEvents), stream.Length());
-                for (HalfLifeModelAnimEvent& event : events) {
+                for (size_t j = 0; j < numEvents; ++j) {
                     mstudioevent_t hlevent = {};
                     eventsStream.ReadStruct(hlevent);
 
+                    HalfLifeModelAnimEvent& event = events[j];
                     event.frame = scast<uint32_t>(hlevent.frame);
                     event.event = scast<uint32_t>(hlevent.event);
                     event.type = scast<uint32_t>(hlevent.type);
-                    event.options = hlevent.options;
+                    event.options = mArena.CopyString(hlevent.options, sizeof(hlevent.options));
                 }
 
-                sequence->SetEvents(events);
+                sequence->SetEvents(ArrayView<HalfLifeModelAnimEvent>(events, numEvents));
             }
         }
-    } else {
-        DebugAssert(false);
     }
 
+    if (!mLoadOptions.lazySequences) {
+        this->DecodeAllSequences();
+    }
+
+    mLoadStats.numThreads = ParallelForThreadsCount(std::max(studioModelJobs.size(), mSequences.size()), mLoadOptions.numThreads);
+
     seqGroupsFiles.clear();
 
+    mLoadStats.sequencesMs = MillisecondsSince(stageStart);
+    if (!this->ReportLoadProgress(0.95f)) {
+        return false;
+    }
+
     // load attachments
     if (stdhdr.numAttachments > 0) {
         mAttachments.resize(stdhdr.numAttachments);
@@ -395,7 +1208,7 @@ bool HalfLifeModel::LoadFromMemStream(MemStream& stream, const studiohdr_t& stdh
             attStream.ReadStruct(hlattachment);
 
             HalfLifeModelAttachment& attachment = mAttachments[i];
-            attachment.name = hlattachment.name;
+            attachment.name = mArena.CopyString(hlattachment.name, sizeof(hlattachment.name));
             attachment.type = hlattachment.type;
             attachment.bone = hlattachment.bone;
             attachment.origin = hlattachment.org;
@@ -422,262 +1235,1095 @@ bool HalfLifeModel::LoadFromMemStream(MemStream& stream, const studiohdr_t& stdh
         }
     }
 
-    mBounds = mSequences[0]->GetBounds();
+    // textures-only files have no sequences, keep the geometry bounds then
+    if (!mSequences.empty()) {
+        mBounds = mSequences[0]->GetBounds();
+    }
+
+    mLoadStats.arenaBytes = mArena.GetReservedSize();
+
+    return true;
+}
+
+// expands tricmds of a single studio model into an indexed triangles list
+// only reads the stream and textures and allocates from the arena, so it's safe to run for different submodels concurrently
+bool HalfLifeModel::LoadStudioModel(const MemStream& stream, const mstudiomodel_t& mdlHdr, HalfLifeModelStudioModel& smdl, AABBox& bounds, VertexCacheStats& vcacheStats) {
+    const ArrayView<vec3f> allModelVertices = stream.GetView<vec3f>(scast<size_t>(mdlHdr.offsetVerices), scast<size_t>(mdlHdr.numVertices));
+    const ArrayView<vec3f> allModelNormals = stream.GetView<vec3f>(scast<size_t>(mdlHdr.offsetNormals), scast<size_t>(mdlHdr.numNormals));
+    const ArrayView<uint8_t> allModelVBones = stream.GetView<uint8_t>(scast<size_t>(mdlHdr.offsetVBonesIndices), scast<size_t>(mdlHdr.numVertices));
+    const ArrayView<uint8_t> allModelNBones = stream.GetView<uint8_t>(scast<size_t>(mdlHdr.offsetNBonesIndices), scast<size_t>(mdlHdr.numNormals));
+
+    // truncated or broken file, leave this submodel empty
+    if (allModelVertices.size() != scast<size_t>(mdlHdr.numVertices) || allModelNormals.size() != scast<size_t>(mdlHdr.numNormals) ||
+        allModelVBones.size() != scast<size_t>(mdlHdr.numVertices) || allModelNBones.size() != scast<size_t>(mdlHdr.numNormals)) {
+        return false;
+    }
+
+    MemStream meshesStream = stream.Substream(scast<size_t>(mdlHdr.offsetMeshes), stream.Length());
+
+    size_t numCorners = 0;
+    for (int meshIdx = 0; meshIdx < mdlHdr.numMeshes; ++meshIdx) {
+        mstudiomesh_t meshHdr = {};
+        meshesStream.ReadStruct(meshHdr);
+        numCorners += CountTriCmdsCorners(rcast<const int16_t*>(stream.Data() + meshHdr.offsetTriangles));
+    }
+    meshesStream.SetCursor(0);
+
+    VertexIndexer indexer;
+    indexer.Reserve(numCorners);
+
+    const size_t numMeshes = scast<size_t>(std::max(0, mdlHdr.numMeshes));
+    HalfLifeModelStudioMesh* meshes = mArena.AllocArray<HalfLifeModelStudioMesh>(numMeshes);
+
+    uint32_t indicesOffset = 0;
+    for (size_t meshIdx = 0; meshIdx < numMeshes; ++meshIdx) {
+        mstudiomesh_t meshHdr = {};
+        meshesStream.ReadStruct(meshHdr);
+
+        HalfLifeModelStudioMesh smesh;
+        smesh.textureIndex = scast<uint32_t>(meshHdr.skinref);
+
+        const HalfLifeModelTexture* hltexture = (smesh.textureIndex < mTextures.size()) ? &mTextures[smesh.textureIndex] : nullptr;
+
+        const float invTexWidth = (hltexture != nullptr) ? (1.0f / scast<float>(hltexture->width)) : 1.0f;
+        const float invTexHeight = (hltexture != nullptr) ? (1.0f / scast<float>(hltexture->height)) : 1.0f;
+
+        auto makeUV = [invTexWidth, invTexHeight](const HLVertexCMD& vcmd)->vec2f {
+            return vec2f(scast<float>(vcmd.u) * invTexWidth, scast<float>(vcmd.v) * invTexHeight);
+        };
+
+        const int16_t* tricmds = rcast<const int16_t*>(stream.Data() + meshHdr.offsetTriangles);
+        int numVertices;
+        uint32_t numIndices = 0;
+        while (numVertices = *(tricmds++)) {
+            if (numVertices < 0) {
+                // this is a triangle fan, convert it to the striangles list
+                numVertices = -numVertices;
+                const HLVertexCMD* vertexCmds = rcast<const HLVertexCMD*>(tricmds);
+                for (int i = 2; i < numVertices; ++i) {
+                    DebugAssert(allModelNBones[vertexCmds[0].normal] == allModelVBones[vertexCmds[0].vertex]);
+                    indexer.AddVertex(allModelVertices[vertexCmds[0].vertex], allModelNormals[vertexCmds[0].normal], makeUV(vertexCmds[0]), allModelVBones[vertexCmds[0].vertex]);
+
+                    DebugAssert(allModelNBones[vertexCmds[i].normal] == allModelVBones[vertexCmds[i].vertex]);
+                    indexer.AddVertex(allModelVertices[vertexCmds[i].vertex], allModelNormals[vertexCmds[i].normal], makeUV(vertexCmds[i]), allModelVBones[vertexCmds[i].vertex]);
+
+                    DebugAssert(allModelNBones[vertexCmds[i-1].normal] == allModelVBones[vertexCmds[i-1].vertex]);
+                    indexer.AddVertex(allModelVertices[vertexCmds[i-1].vertex], allModelNormals[vertexCmds[i-1].normal], makeUV(vertexCmds[i-1]), allModelVBones[vertexCmds[i-1].vertex]);
+                }
+
+                tricmds += numVertices * 4;
+                numIndices += scast<uint32_t>((numVertices - 2) * 3);
+            } else {
+                // this is a triangle strip, convert it to the striangles list
+                const HLVertexCMD* vertexCmds = rcast<const HLVertexCMD*>(tricmds);
+                for (int i = 0; i < numVertices - 2; ++i) {
+                    DebugAssert(allModelNBones[vertexCmds[i].normal] == allModelVBones[vertexCmds[i].vertex]);
+                    indexer.AddVertex(allModelVertices[vertexCmds[i].vertex], allModelNormals[vertexCmds[i].normal], makeUV(vertexCmds[i]), allModelVBones[vertexCmds[i].vertex]);
+
+                    if (i & 1) {
+                        DebugAssert(allModelNBones[vertexCmds[i+1].normal] == allModelVBones[vertexCmds[i+1].vertex]);
+                        indexer.AddVertex(allModelVertices[vertexCmds[i+1].vertex], allModelNormals[vertexCmds[i+1].normal], makeUV(vertexCmds[i+1]), allModelVBones[vertexCmds[i+1].vertex]);
+
+                        DebugAssert(allModelNBones[vertexCmds[i+2].normal] == allModelVBones[vertexCmds[i+2].vertex]);
+                        indexer.AddVertex(allModelVertices[vertexCmds[i+2].vertex], allModelNormals[vertexCmds[i+2].normal], makeUV(vertexCmds[i+2]), allModelVBones[vertexCmds[i+2].vertex]);
+                    } else {
+                        DebugAssert(allModelNBones[vertexCmds[i+2].normal] == allModelVBones[vertexCmds[i+2].vertex]);
+                        indexer.AddVertex(allModelVertices[vertexCmds[i+2].vertex], allModelNormals[vertexCmds[i+2].normal], makeUV(vertexCmds[i+2]), allModelVBones[vertexCmds[i+2].vertex]);
+
+                        DebugAssert(allModelNBones[vertexCmds[i+1].normal] == allModelVBones[vertexCmds[i+1].vertex]);
+                        indexer.AddVertex(allModelVertices[vertexCmds[i+1].vertex], allModelNormals[vertexCmds[i+1].normal], makeUV(vertexCmds[i+1]), allModelVBones[vertexCmds[i+1].vertex]);
+                    }
+                }
+
+                tricmds += numVertices * 4;
+                numIndices += scast<uint32_t>((numVertices - 2) * 3);
+            }
+        }
+
+        smesh.numIndices = numIndices;
+        smesh.indicesOffset = indicesOffset;
+
+        indicesOffset += numIndices;
+
+        meshes[meshIdx] = smesh;
+    }
+
+    MyArray<uint32_t> timestamps(indexer.vertices.size());
+    vcacheStats.numTriangles = indexer.indices.size() / 3;
+    vcacheStats.missesBefore = CountVertexCacheMisses(indexer.indices.data(), indexer.indices.size(), timestamps);
+    vcacheStats.missesAfter = vcacheStats.missesBefore;
+    if (mLoadOptions.optimizeVertexCache) {
+        OptimizeMeshesVertexCache(meshes, numMeshes, indexer.indices, indexer.vertices);
+        vcacheStats.missesAfter = CountVertexCacheMisses(indexer.indices.data(), indexer.indices.size(), timestamps);
+    }
+
+    smdl.SetMeshes(ArrayView<HalfLifeModelStudioMesh>(meshes, numMeshes));
+    smdl.SetVertices(mArena.CopyArray(indexer.vertices.data(), indexer.vertices.size()));
+    // 16-bit indices are half the memory and bandwidth, only huge welded submodels need the full 32 bits
+    const size_t numIndices = indexer.indices.size();
+    if (indexer.vertices.size() <= kMaxShortIndexVertices) {
+        uint16_t* indices = mArena.AllocArray<uint16_t>(numIndices);
+        for (size_t i = 0; i < numIndices; ++i) {
+            indices[i] = scast<uint16_t>(indexer.indices[i]);
+        }
+        smdl.SetIndices(ArrayView<uint16_t>(indices, numIndices));
+    } else {
+        smdl.SetIndices(mArena.CopyArray(indexer.indices.data(), numIndices));
+    }
+
+    bounds = indexer.bounds;
+
+    return true;
+}
+
+void HalfLifeModel::LoadTextures(MemStream& stream, const size_t numTextures, const size_t texturesOffset) {
+    MemStream texturesStream = stream.Substream(texturesOffset, stream.Length());
+
+    mTextures.resize(numTextures);
+    for (size_t i = 0; i < numTextures; ++i) {
+        mstudiotexture_t thdr = {};
+        texturesStream.ReadStruct(thdr);
+
+        HalfLifeModelTexture& tex = mTextures[i];
+        tex.name = mArena.CopyString(thdr.name, sizeof(thdr.name));
+        tex.width = scast<uint32_t>(thdr.width);
+        tex.height = scast<uint32_t>(thdr.height);
+        tex.chrome = (thdr.flags & STUDIO_NF_CHROME) == STUDIO_NF_CHROME;
+        tex.additive = (thdr.flags & STUDIO_NF_ADDITIVE) == STUDIO_NF_ADDITIVE;
+        tex.masked = (thdr.flags & STUDIO_NF_MASKED) == STUDIO_NF_MASKED;
+
+        const size_t numPixels = scast<size_t>(tex.width) * scast<size_t>(tex.height);
+        tex.data = stream.GetView<uint8_t>(scast<size_t>(thdr.offset), numPixels);
+        tex.palette = stream.GetView<uint8_t>(scast<size_t>(thdr.offset) + numPixels, kPaletteSize);
+        if (tex.data.size() != numPixels || tex.palette.size() != kPaletteSize) {
+            // broken texture, substitute it with a single black pixel
+            tex.width = tex.height = 1;
+            tex.data = ArrayView<uint8_t>(kBlackPalette, 1);
+            tex.palette = ArrayView<uint8_t>(kBlackPalette, kPaletteSize);
+        }
+    }
+}
+
+void HalfLifeModel::LoadSkins(MemStream& stream, const size_t numSkins, const size_t numTexturesPerSkin, const size_t skinsOffset) {
+    mSkins.resize(numSkins);
+    for (size_t i = 0; i < numSkins; ++i) {
+        // an empty table means identity remap, see GetSkinTexture
+        mSkins[i].remapTable = stream.GetView<uint16_t>(skinsOffset + i * numTexturesPerSkin * sizeof(uint16_t), numTexturesPerSkin);
+    }
+}
+
+size_t HalfLifeModel::GetBodyPartsCount() const {
+    return mBodyParts.size();
+}
+
+const HalfLifeModelBodypart* HalfLifeModel::GetBodyPart(const size_t idx) const {
+    return mBodyParts[idx];
+}
+
+size_t HalfLifeModel::GetBonesCount() const {
+    return mBones.size();
+}
+
+const HalfLifeModelBone& HalfLifeModel::GetBone(const size_t idx) const {
+    return mBones[idx];
+}
+
+size_t HalfLifeModel::GetBoneControllersCount() const {
+    return mBoneControllers.size();
+}
+
+const HalfLifeModelBoneController& HalfLifeModel::GetBoneController(const size_t idx) const {
+    return mBoneControllers[idx];
+}
+
+size_t HalfLifeModel::GetTexturesCount() const {
+    return mTextures.size();
+}
+
+const HalfLifeModelTexture& HalfLifeModel::GetTexture(const size_t idx) const {
+    return mTextures[idx];
+}
+
+size_t HalfLifeModel::GetSkinsCount() const {
+    return mSkins.size();
+}
+
+size_t HalfLifeModel::GetSkinTexture(const size_t skinIdx, const size_t textureIdx) const {
+    if (skinIdx >= mSkins.size()) {
+        return textureIdx;
+    }
+
+    const HalfLifeModelSkin& skin = mSkins[skinIdx];
+    if (textureIdx < skin.remapTable.size()) {
+        return skin.remapTable[textureIdx];
+    } else {
+        return textureIdx;
+    }
+}
+
+const AABBox& HalfLifeModel::GetBounds() const {
+    return mBounds;
+}
+
+size_t HalfLifeModel::GetSequencesCount() const {
+    return mSequences.size();
+}
+
+const HalfLifeModelSequence* HalfLifeModel::GetSequence(const size_t idx) const {
+    return mSequences[idx];
+}
+
+size_t HalfLifeModel::GetDecodedAnimSize() const {
+    return mAnimState->decodedSize;
+}
+
+size_t HalfLifeModel::GetBakedPosesSize() const {
+    return mAnimState->bakedSize;
+}
+
+size_t HalfLifeModel::GetMemorySize() const {
+    // eagerly decoded animation lives in the arena
+    const size_t animSize = mLoadOptions.lazySequences ? this->GetDecodedAnimSize() : 0;
+    return mModelStream.Length() + mTexturesStream.Length() + mArena.GetReservedSize() + animSize + this->GetBakedPosesSize();
+}
+
+MyArray<fs::path> HalfLifeModel::GetSourceFiles() const {
+    // the same lookups LoadFromPath and LoadSequenceGroupFile do
+    fs::path tmodelPath = mSourcePath;
+    tmodelPath.replace_extension("");
+    tmodelPath += "t.mdl";
+
+    MyArray<fs::path> files = { mSourcePath, tmodelPath };
+    for (size_t i = 1; i < mSequenceGroups.size(); ++i) {
+        files.push_back(mSourcePath.parent_path() / fs::path(mSequenceGroups[i].name).filename());
+    }
+    return files;
+}
+
+// decodes the sequence animation ahead of its first use, subject to the same budget (lazy mode only)
+void HalfLifeModel::PreloadSequenceAnim(const size_t sequenceIdx) const {
+    if (sequenceIdx < mSequences.size()) {
+        this->TouchSequenceAnim(sequenceIdx);
+    }
+}
+
+size_t HalfLifeModel::GetAttachmentsCount() const {
+    return mAttachments.size();
+}
+
+const HalfLifeModelAttachment& HalfLifeModel::GetAttachment(const size_t idx) const {
+    return mAttachments[idx];
+}
+
+size_t HalfLifeModel::GetHitBoxesCount() const {
+    return mHitBoxes.size();
+}
+
+const HalfLifeModelHitBox& HalfLifeModel::GetHitBox(const size_t idx) const {
+    return mHitBoxes[idx];
+}
+
+void HalfLifeModel::CalculateSkeleton(const float frame, const size_t sequenceIdx, const float* controllerValues, mat4f* skeleton) const {
+    if (!mBones.empty() && !mSequences.empty()) {
+        const std::shared_lock<std::shared_mutex> animLock = this->LockSequenceAnim(sequenceIdx);
+        const std::shared_lock<std::shared_mutex> bakeLock = this->LockSequenceBake(sequenceIdx);
+        mSequences[sequenceIdx]->CalculateSkeleton(frame, controllerValues, skeleton);
+    }
+}
+
+void HalfLifeModel::LoadSequenceAnim(HalfLifeModelSequence* sequence, const MemStream& stream, const size_t offsetAnim) const {
+    const ArrayView<mstudioanim_t> animData = stream.GetView<mstudioanim_t>(offsetAnim, mBones.size());
+    if (animData.size() != mBones.size()) {
+        return;
+    }
+
+    // decoding itself is deferred, either to the end of the load (eager mode) or to the first use (lazy mode)
+    sequence->SetAnimData(animData.data());
+}
+
+// returns with the sequence decoded and safe from eviction for as long as the lock is held
+// in eager mode nothing ever changes after the load, so there's nothing to lock
+std::shared_lock<std::shared_mutex> HalfLifeModel::LockSequenceAnim(const size_t sequenceIdx) const {
+    if (!mLoadOptions.lazySequences) {
+        return {};
+    }
+
+    for (;;) {
+        std::shared_lock<std::shared_mutex> lock(mAnimState->lock);
+        if (mSequences[sequenceIdx]->IsAnimDecoded()) {
+            mAnimState->lastUse[sequenceIdx] = ++mAnimState->useCounter;
+            return lock;
+        }
+        lock.unlock();
+
+        // might get evicted by someone else before we get the lock back, then we just go again
+        this->TouchSequenceAnim(sequenceIdx);
+    }
+}
+
+// returns with the sequence baked and safe from eviction for as long as the lock is held
+// the sequences that can't be baked are just evaluated every time
+std::shared_lock<std::shared_mutex> HalfLifeModel::LockSequenceBake(const size_t sequenceIdx) const {
+    if (!mLoadOptions.bakedPosesBudget) {
+        return {};
+    }
+
+    for (;;) {
+        std::shared_lock<std::shared_mutex> lock(mAnimState->bakeLock);
+        if (mSequences[sequenceIdx]->HasBakedPoses() || mAnimState->bakeRejected[sequenceIdx]) {
+            mAnimState->bakeLastUse[sequenceIdx] = ++mAnimState->useCounter;
+            return lock;
+        }
+        lock.unlock();
+
+        // might get evicted by someone else before we get the lock back, then we just go again
+        this->BakeSequencePoses(sequenceIdx);
+    }
+}
+
+// makes room for the sequence poses by releasing the least recently played ones, a sequence too big for the whole budget is never baked
+void HalfLifeModel::BakeSequencePoses(const size_t sequenceIdx) const {
+    const std::lock_guard<std::shared_mutex> lock(mAnimState->bakeLock);
+
+    const SequencePtr& sequence = mSequences[sequenceIdx];
+    if (sequence->HasBakedPoses() || mAnimState->bakeRejected[sequenceIdx]) {
+        return;
+    }
+
+    const size_t budget = mLoadOptions.bakedPosesBudget;
+    const size_t size = scast<size_t>(sequence->GetFramesCount()) * mBones.size() * sizeof(HalfLifeModelBakedBone);
+    if (size > budget) {
+        mAnimState->bakeRejected[sequenceIdx] = true;
+        return;
+    }
+
+    size_t bakedSize = mAnimState->bakedSize;
+    while (bakedSize + size > budget) {
+        size_t victimIdx = mSequences.size();
+        for (size_t i = 0; i < mSequences.size(); ++i) {
+            if (mSequences[i]->HasBakedPoses()) {
+                if (victimIdx == mSequences.size() || mAnimState->bakeLastUse[i] < mAnimState->bakeLastUse[victimIdx]) {
+                    victimIdx = i;
+                }
+            }
+        }
+
+        if (victimIdx == mSequences.size()) {
+            break;
+        }
+
+        bakedSize -= mSequences[victimIdx]->GetBakedPosesSize();
+        mSequences[victimIdx]->ReleaseBakedPoses();
+    }
+
+    if (sequence->BakePoses()) {
+        bakedSize += sequence->GetBakedPosesSize();
+    } else {
+        mAnimState->bakeRejected[sequenceIdx] = true;
+    }
+
+    mAnimState->bakedSize = bakedSize;
+}
+
+// marks the sequence as most recently used, decodes it if needed and evicts the least recently used ones if we're over the budget
+void HalfLifeModel::TouchSequenceAnim(const size_t sequenceIdx) const {
+    if (!mLoadOptions.lazySequences) {
+        return;
+    }
+
+    const std::lock_guard<std::shared_mutex> lock(mAnimState->lock);
+
+    mAnimState->lastUse[sequenceIdx] = ++mAnimState->useCounter;
+
+    const SequencePtr& sequence = mSequences[sequenceIdx];
+    if (sequence->IsAnimDecoded()) {
+        return;
+    }
+
+    // external groups are loaded only for the time of decoding, evicted sequences load them again
+    // (sequences restored from the cache have their data at hand)
+    const size_t groupIdx = sequence->GetSequenceGroup();
+    if (groupIdx > 0 && groupIdx < mSequenceGroups.size() && !mAnimState->groupsMissing[groupIdx] && !sequence->HasAnimData()) {
+        MemStream groupStream = this->LoadSequenceGroupFile(groupIdx);
+        if (groupStream) {
+            this->LoadSequenceAnim(sequence, groupStream, mSequencesAnimOffset[sequenceIdx]);
+            sequence->DecodeAnim();
+        } else {
+            mAnimState->groupsMissing[groupIdx] = true;
+        }
+        sequence->SetAnimData(nullptr);
+    }
+
+    // sequences without data (missing group files) end up decoded as empty
+    if (!sequence->IsAnimDecoded()) {
+        sequence->DecodeAnim();
+    }
+
+    size_t decodedSize = mAnimState->decodedSize + sequence->GetAnimMemorySize();
+
+    const size_t budget = mLoadOptions.decodedAnimBudget;
+    while (budget > 0 && decodedSize > budget) {
+        size_t victimIdx = mSequences.size();
+        for (size_t i = 0; i < mSequences.size(); ++i) {
+            if (i != sequenceIdx && mSequences[i]->IsAnimDecoded() && mSequences[i]->GetAnimMemorySize() > 0) {
+                if (victimIdx == mSequences.size() || mAnimState->lastUse[i] < mAnimState->lastUse[victimIdx]) {
+                    victimIdx = i;
+                }
+            }
+        }
+
+        if (victimIdx == mSequences.size()) {
+            break;
+        }
+
+        decodedSize -= mSequences[victimIdx]->GetAnimMemorySize();
+        mSequences[victimIdx]->ReleaseAnim();
+    }
+
+    mAnimState->decodedSize = decodedSize;
+}
+
+MemStream HalfLifeModel::LoadSequenceGroupFile(const size_t groupIdx) const {
+    const fs::path seqGroupFileName = fs::path(mSequenceGroups[groupIdx].name).filename();
+    return CheckSequenceGroupFile(VirtualFileSystem::ReadFile(mSourcePath.parent_path() / seqGroupFileName));
+}
+
+MemStream HalfLifeModel::CheckSequenceGroupFile(MemStream seqStream) {
+    if (seqStream) {
+        studiohdr_t seqStdhdr = {};
+        seqStream.ReadStruct(seqStdhdr);
+        if (HalfLifeModel::kIDSQMagic == seqStdhdr.magic) {
+            return seqStream;
+        }
+    }
+
+    return {};
+}
+
+// external groups are needed for decoding in eager mode only, lazy mode reads them on demand
+void HalfLifeModel::StartSequenceGroupsReads(const MemStream& stream, const studiohdr_t& stdhdr) {
+    mSeqGroupsReads.clear();
+    if (mLoadOptions.lazySequences || stdhdr.numSeqGroups <= 1) {
+        return;
+    }
+
+    const ArrayView<mstudioseqgroup_t> seqGroups = stream.GetView<mstudioseqgroup_t>(scast<size_t>(stdhdr.offsetSeqGroups), scast<size_t>(stdhdr.numSeqGroups));
+    mSeqGroupsReads.resize(seqGroups.size());
+    for (size_t i = 1; i < seqGroups.size(); ++i) {
+        const mstudioseqgroup_t& hlSeqGrp = seqGroups[i];
+        const fs::path seqGroupFileName = fs::path(StringView(hlSeqGrp.name, strnlen(hlSeqGrp.name, sizeof(hlSeqGrp.name)))).filename();
+        mSeqGroupsReads[i] = ReadFileAsync(mSourcePath.parent_path() / seqGroupFileName, mLoadOptions.concurrentReads);
+    }
+}
+
+// the file StartSequenceGroupsReads is reading, or read it now if it's not
+MemStream HalfLifeModel::TakeSequenceGroupFile(const size_t groupIdx) {
+    if (groupIdx < mSeqGroupsReads.size() && mSeqGroupsReads[groupIdx].valid()) {
+        return CheckSequenceGroupFile(mSeqGroupsReads[groupIdx].get());
+    }
+
+    return this->LoadSequenceGroupFile(groupIdx);
+}
+
+// sequences are independent from each other, so in eager mode we decode them all at once
+// every sequence only writes its own frames, nothing is buffered besides the already mapped source files
+void HalfLifeModel::DecodeAllSequences() {
+    const LoadClock::time_point decodeStart = LoadClock::now();
+
+    ParallelFor(mSequences.size(), mLoadOptions.numThreads, [this](const size_t seqIdx) {
+        mSequences[seqIdx]->DecodeAnim(&mArena);
+    });
+
+    // sequence groups data is released after load, and without the source the decoded data is never evicted
+    size_t decodedSize = 0;
+    for (SequencePtr& sequence : mSequences) {
+        sequence->SetAnimData(nullptr);
+        decodedSize += sequence->GetAnimMemorySize();
+    }
+    mAnimState->decodedSize = decodedSize;
+
+    mLoadStats.decodeMs = MillisecondsSince(decodeStart);
+}
+
+bool HalfLifeModel::ReportLoadProgress(const float progress) const {
+    return !mLoadOptions.progressCallback || mLoadOptions.progressCallback(progress);
+}
+
+// one cache file per model path and per combination of the load options the cached data depends on, the name is a hash of the path
+// plus the options bits, so loaders with different options (say the viewer and hlmvqt-cli) don't keep replacing each other's files
+fs::path HalfLifeModel::GetCachePath(const fs::path& filePath) const {
+    std::error_code ec;
+    const CharString absPath = fs::absolute(filePath, ec).u8string();
+    const uint64_t pathHash = HashBytes(absPath.data(), absPath.size());
+    // only the meshes order depends on the options, sequences are cached raw and decoded (and baked) on load
+    const uint32_t optionsBits = mLoadOptions.optimizeVertexCache ? 1u : 0u;
+
+    return mLoadOptions.cacheDir / (FormatHex64(pathHash) + "-" + std::to_string(optionsBits) + ".hlmvcache");
+}
+
+bool HalfLifeModel::LoadFromCache(const fs::path& cachePath) {
+    MemStream stream = VirtualFileSystem::ReadFile(cachePath);
+    if (!stream || stream.Length() < sizeof(HLCacheHeader)) {
+        return false;
+    }
+
+    HLCacheHeader header = {};
+    stream.ReadStruct(header);
+    if (header.magic != kCacheMagic || header.version != kCacheVersion || header.layout != kCacheLayout ||
+        header.payloadSize != stream.Length() - sizeof(HLCacheHeader) ||
+        header.payloadHash != HashBytes(stream.Data() + sizeof(HLCacheHeader), scast<size_t>(header.payloadSize))) {
+        return false;
+    }
+
+    // sources have to be exactly the same as the cache was built from
+    const fs::path folder = mSourcePath.parent_path();
+    const uint32_t numDependencies = stream.ReadU32();
+    if (!numDependencies) {
+        return false;
+    }
+    for (uint32_t i = 0; i < numDependencies; ++i) {
+        HLCacheDependency dep = {};
+        dep.fileName = CharString(ReadCacheString(stream));
+        dep.present = stream.ReadBool();
+        dep.size = stream.ReadU64();
+        dep.mtime = stream.ReadI64();
+        dep.contentHash = stream.ReadU64();
+        if (!IsCacheDependencyUpToDate(folder, dep)) {
+            return false;
+        }
+    }
+
+    // meshes are stored as they are drawn, so they have to be optimized (or not) the same way as asked now
+    if (stream.ReadBool() != mLoadOptions.optimizeVertexCache) {
+        return false;
+    }
+    mLoadStats.acmrBefore = stream.ReadF32();
+    mLoadStats.acmrAfter = stream.ReadF32();
+
+    // textures and skins
+    mTextures.resize(stream.ReadU32());
+    for (HalfLifeModelTexture& tex : mTextures) {
+        tex.name = ReadCacheString(stream);
+        tex.width = stream.ReadU32();
+        tex.height = stream.ReadU32();
+        tex.chrome = stream.ReadBool();
+        tex.additive = stream.ReadBool();
+        tex.masked = stream.ReadBool();
+        if (!ReadCacheArray(stream, tex.data) || !ReadCacheArray(stream, tex.palette)) {
+            return false;
+        }
+    }
+
+    mSkins.resize(stream.ReadU32());
+    for (HalfLifeModelSkin& skin : mSkins) {
+        if (!ReadCacheArray(stream, skin.remapTable)) {
+            return false;
+        }
+    }
+
+    // geometry
+    mBodyParts.resize(stream.ReadU32());
+    for (BodyPartPtr& bodyPart : mBodyParts) {
+        bodyPart = mArena.New<HalfLifeModelBodypart>();
+        bodyPart->SetName(ReadCacheString(stream));
+
+        const uint32_t numModels = stream.ReadU32();
+        HalfLifeModelStudioModel** models = mArena.AllocArray<HalfLifeModelStudioModel*>(numModels);
+        for (uint32_t i = 0; i < numModels; ++i) {
+            HalfLifeModelStudioModel* smdl = mArena.New<HalfLifeModelStudioModel>();
+            smdl->SetName(ReadCacheString(stream));
+            smdl->SetType(stream.ReadI32());
+            smdl->SetBoundingRadius(stream.ReadF32());
+
+            ArrayView<HalfLifeModelVertex> vertices;
+            if (!ReadCacheArray(stream, vertices)) {
+                return false;
+            }
+
+            // geometry is used right from the cache file memory
+            const uint32_t indexSize = stream.ReadU32();
+            if (indexSize == sizeof(uint32_t)) {
+                ArrayView<uint32_t> indices;
+                if (!ReadCacheArray(stream, indices)) {
+                    return false;
+                }
+                smdl->SetIndices(indices);
+            } else if (indexSize == sizeof(uint16_t)) {
+                ArrayView<uint16_t> indices;
+                if (!ReadCacheArray(stream, indices)) {
+                    return false;
+                }
+                smdl->SetIndices(indices);
+            } else {
+                return false;
+            }
+
+            ArrayView<HalfLifeModelStudioMesh> meshes;
+            if (!ReadCacheArray(stream, meshes)) {
+                return false;
+            }
+
+            smdl->SetVertices(vertices);
+            smdl->SetMeshes(meshes);
+
+            models[i] = smdl;
+        }
+        bodyPart->SetStudioModels(ArrayView<HalfLifeModelStudioModel*>(models, numModels));
+    }
+
+    // skeleton
+    mBones.resize(stream.ReadU32());
+    for (HalfLifeModelBone& bone : mBones) {
+        bone.name = ReadCacheString(stream);
+        bone.parentIdx = stream.ReadI32();
+        stream.ReadStruct(bone.pos);
+        stream.ReadStruct(bone.rot);
+        stream.ReadStruct(bone.scalePos);
+        stream.ReadStruct(bone.scaleRot);
+        stream.ReadStruct(bone.controllerIdx);
+    }
+
+    mBoneControllers.resize(stream.ReadU32());
+    for (HalfLifeModelBoneController& bcontroller : mBoneControllers) {
+        stream.ReadStruct(bcontroller);
+    }
+
+    stream.ReadStruct(mBounds);
+
+    // sequences
+    mSequenceGroups.resize(stream.ReadU32());
+    mAnimState->groupsMissing.resize(mSequenceGroups.size(), false);
+    for (HalfLifeModelSequenceGroup& seqGrp : mSequenceGroups) {
+        seqGrp.label = ReadCacheString(stream);
+        seqGrp.name = ReadCacheString(stream);
+        seqGrp.data = stream.ReadI32();
+    }
+
+    mSequences.resize(stream.ReadU32());
+    mAnimState->lastUse = MakeStrongPtr<std::atomic<uint64_t>[]>(mSequences.size());
+    mAnimState->bakeLastUse = MakeStrongPtr<std::atomic<uint64_t>[]>(mSequences.size());
+    mAnimState->bakeRejected.resize(mSequences.size(), false);
+    mSequencesAnimOffset.resize(mSequences.size(), 0);
+    for (size_t i = 0; i < mSequences.size(); ++i) {
+        SequencePtr& sequence = mSequences[i];
+        sequence = mArena.New<HalfLifeModelSequence>(mArena, ArrayView<HalfLifeModelBone>(mBones.data(), mBones.size()),
+                                                     ArrayView<HalfLifeModelBoneController>(mBoneControllers.data(), mBoneControllers.size()), mLoadOptions.precomputeRotations);
+        sequence->SetName(ReadCacheString(stream));
+        sequence->SetFPS(stream.ReadF32());
+        sequence->SetMotionType(stream.ReadU32());
+        sequence->SetMotionBone(stream.ReadU32());
+        sequence->SetSequenceGroup(stream.ReadU32());
+        sequence->SetFramesCount(stream.ReadU32());
+        AABBox bounds;
+        stream.ReadStruct(bounds);
+        sequence->SetBounds(bounds);
+        mSequencesAnimOffset[i] = scast<size_t>(stream.ReadU64());
+
+        const uint32_t numEvents = stream.ReadU32();
+        HalfLifeModelAnimEvent* events = mArena.AllocArray<HalfLifeModelAnimEvent>(numEvents);
+        for (uint32_t j = 0; j < numEvents; ++j) {
+            HalfLifeModelAnimEvent& event = events[j];
+            event.frame = stream.ReadU32();
+            event.event = stream.ReadU32();
+            event.type = stream.ReadU32();
+            event.options = ReadCacheString(stream);
+        }
+        sequence->SetEvents(ArrayView<HalfLifeModelAnimEvent>(events, numEvents));
+
+        // empty if the sequence group file was missing, it's looked up again on use then
+        ArrayView<uint8_t> animData;
+        if (!ReadCacheArray(stream, animData)) {
+            return false;
+        }
+        if (!animData.empty()) {
+            sequence->SetAnimData(rcast<const mstudioanim_t*>(animData.data()));
+        }
+    }
+
+    // attachments and hitboxes
+    mAttachments.resize(stream.ReadU32());
+    for (HalfLifeModelAttachment& attachment : mAttachments) {
+        attachment.name = ReadCacheString(stream);
+        attachment.type = stream.ReadI32();
+        attachment.bone = stream.ReadI32();
+        stream.ReadStruct(attachment.origin);
+        stream.ReadStruct(attachment.vectors);
+    }
+
+    mHitBoxes.resize(stream.ReadU32());
+    for (HalfLifeModelHitBox& hitbox : mHitBoxes) {
+        stream.ReadStruct(hitbox);
+    }
+
+    if (stream.ReadU32() != kCacheMagic) {
+        return false;
+    }
+
+    // keeps the recently used files away from TrimCacheFolder
+    std::error_code ec;
+    fs::last_write_time(cachePath, fs::file_time_type::clock::now(), ec);
+
+    mModelStream = stream;
+    if (!mLoadOptions.lazySequences) {
+        this->DecodeAllSequences();
+    }
+    mLoadStats.numThreads = ParallelForThreadsCount(mSequences.size(), mLoadOptions.numThreads);
+    mLoadStats.arenaBytes = mArena.GetReservedSize();
 
     return true;
 }
 
-void HalfLifeModel::LoadTextures(MemStream& stream, const size_t numTextures, const size_t texturesOffset) {
-    MemStream texturesStream = stream.Substream(texturesOffset, stream.Length());
+// failing to write the cache is not an error, the model is just parsed again next time
+void HalfLifeModel::SaveToCache(const fs::path& cachePath) const {
+    const fs::path folder = mSourcePath.parent_path();
 
-    mTextures.resize(numTextures);
-    for (size_t i = 0; i < numTextures; ++i) {
-        mstudiotexture_t thdr = {};
-        texturesStream.ReadStruct(thdr);
+    // the same lookups LoadFromPath and LoadSequenceGroupFile do
+    fs::path tmodelName = mSourcePath.filename();
+    tmodelName.replace_extension("");
+    tmodelName += "t.mdl";
 
-        HalfLifeModelTexture& tex = mTextures[i];
-        tex.name = thdr.name;
-        tex.width = scast<uint32_t>(thdr.width);
-        tex.height = scast<uint32_t>(thdr.height);
-        tex.chrome = (thdr.flags & STUDIO_NF_CHROME) == STUDIO_NF_CHROME;
-        tex.additive = (thdr.flags & STUDIO_NF_ADDITIVE) == STUDIO_NF_ADDITIVE;
-        tex.masked = (thdr.flags & STUDIO_NF_MASKED) == STUDIO_NF_MASKED;
-        tex.data.resize(tex.width * tex.height);
-        tex.palette.resize(256 * 3);
+    // hashed from what is already in memory, every group file is read once for both its hash and its frames
+    MyArray<HLCacheDependency> dependencies;
+    dependencies.push_back(DescribeCacheDependency(folder, mSourcePath.filename().u8string(), mModelStream));
+    dependencies.push_back(DescribeCacheDependency(folder, tmodelName.u8string(), mTexturesStream));
 
-        MemStream texDataStream = stream.Substream(scast<size_t>(thdr.offset), stream.Length());
-        texDataStream.ReadToBuffer(tex.data.data(), tex.data.size());
-        texDataStream.ReadToBuffer(tex.palette.data(), tex.palette.size());
+    MyArray<MemStream> seqGroupsFiles(mSequenceGroups.size());
+    for (size_t i = 1; i < mSequenceGroups.size(); ++i) {
+        seqGroupsFiles[i] = this->LoadSequenceGroupFile(i);
+        dependencies.push_back(DescribeCacheDependency(folder, fs::path(mSequenceGroups[i].name).filename().u8string(), seqGroupsFiles[i]));
     }
-}
 
-void HalfLifeModel::LoadSkins(MemStream& stream, const size_t numSkins, const size_t numTexturesPerSkin, const size_t skinsOffset) {
-    MemStream skinsStream = stream.Substream(skinsOffset, stream.Length());
+    MemWriteStream stream;
+    stream.WriteStruct(HLCacheHeader{});
 
-    mSkins.resize(numSkins);
-    for (HalfLifeModelSkin& skin : mSkins) {
-        skin.remapTable.resize(numTexturesPerSkin);
-        skinsStream.ReadToBuffer(skin.remapTable.data(), numTexturesPerSkin * sizeof(uint16_t));
+    stream.WriteU32(scast<uint32_t>(dependencies.size()));
+    for (const HLCacheDependency& dep : dependencies) {
+        WriteCacheString(stream, dep.fileName);
+        stream.WriteBool(dep.present);
+        stream.WriteU64(dep.size);
+        stream.WriteI64(dep.mtime);
+        stream.WriteU64(dep.contentHash);
     }
-}
 
-size_t HalfLifeModel::GetBodyPartsCount() const {
-    return mBodyParts.size();
-}
+    stream.WriteBool(mLoadOptions.optimizeVertexCache);
+    stream.WriteF32(mLoadStats.acmrBefore);
+    stream.WriteF32(mLoadStats.acmrAfter);
+
+    // textures and skins
+    stream.WriteU32(scast<uint32_t>(mTextures.size()));
+    for (const HalfLifeModelTexture& tex : mTextures) {
+        WriteCacheString(stream, tex.name);
+        stream.WriteU32(tex.width);
+        stream.WriteU32(tex.height);
+        stream.WriteBool(tex.chrome);
+        stream.WriteBool(tex.additive);
+        stream.WriteBool(tex.masked);
+        WriteCacheArray(stream, tex.data.data(), tex.data.size());
+        WriteCacheArray(stream, tex.palette.data(), tex.palette.size());
+    }
 
-HalfLifeModelBodypart* HalfLifeModel::GetBodyPart(const size_t idx) const {
-    return mBodyParts[idx].get();
-}
+    stream.WriteU32(scast<uint32_t>(mSkins.size()));
+    for (const HalfLifeModelSkin& skin : mSkins) {
+        WriteCacheArray(stream, skin.remapTable.data(), skin.remapTable.size());
+    }
 
-void HalfLifeModel::SetBodyPartActiveSubModel(const size_t bodyPartIdx, const size_t subModelIdx) {
-    mActiveBodyPartSubModel[bodyPartIdx] = subModelIdx;
-}
+    // geometry
+    stream.WriteU32(scast<uint32_t>(mBodyParts.size()));
+    for (const BodyPartPtr& bodyPart : mBodyParts) {
+        WriteCacheString(stream, bodyPart->GetName());
+
+        stream.WriteU32(scast<uint32_t>(bodyPart->GetStudioModelsCount()));
+        for (size_t i = 0; i < bodyPart->GetStudioModelsCount(); ++i) {
+            const HalfLifeModelStudioModel* smdl = bodyPart->GetStudioModel(i);
+            WriteCacheString(stream, smdl->GetName());
+            stream.WriteI32(smdl->GetType());
+            stream.WriteF32(smdl->GetBoundingRadius());
+
+            WriteCacheArray(stream, smdl->GetVertices(), smdl->GetVerticesCount());
+            stream.WriteU32(scast<uint32_t>(smdl->GetIndexSize()));
+            if (smdl->GetIndexSize() == sizeof(uint32_t)) {
+                WriteCacheArray(stream, scast<const uint32_t*>(smdl->GetIndicesData()), smdl->GetIndicesCount());
+            } else {
+                WriteCacheArray(stream, scast<const uint16_t*>(smdl->GetIndicesData()), smdl->GetIndicesCount());
+            }
 
-size_t HalfLifeModel::GetBodyPartActiveSubModel(const size_t bodyPartIdx) const {
-    return mActiveBodyPartSubModel[bodyPartIdx];
-}
+            MyArray<HalfLifeModelStudioMesh> meshes(smdl->GetMeshesCount());
+            for (size_t j = 0; j < meshes.size(); ++j) {
+                meshes[j] = smdl->GetMesh(j);
+            }
+            WriteCacheArray(stream, meshes.data(), meshes.size());
+        }
+    }
 
-size_t HalfLifeModel::GetBonesCount() const {
-    return mBones.size();
-}
+    // skeleton
+    stream.WriteU32(scast<uint32_t>(mBones.size()));
+    for (const HalfLifeModelBone& bone : mBones) {
+        WriteCacheString(stream, bone.name);
+        stream.WriteI32(bone.parentIdx);
+        stream.WriteStruct(bone.pos);
+        stream.WriteStruct(bone.rot);
+        stream.WriteStruct(bone.scalePos);
+        stream.WriteStruct(bone.scaleRot);
+        stream.WriteStruct(bone.controllerIdx);
+    }
 
-const HalfLifeModelBone& HalfLifeModel::GetBone(const size_t idx) const {
-    return mBones[idx];
-}
+    stream.WriteU32(scast<uint32_t>(mBoneControllers.size()));
+    for (const HalfLifeModelBoneController& bcontroller : mBoneControllers) {
+        stream.WriteStruct(bcontroller);
+    }
 
-const mat4f& HalfLifeModel::GetBoneMat(const size_t idx) const {
-    return mSkeleton[idx];
-}
+    stream.WriteStruct(mBounds);
 
-size_t HalfLifeModel::GetBoneControllersCount() const {
-    return mBoneControllers.size();
-}
+    // sequences
+    stream.WriteU32(scast<uint32_t>(mSequenceGroups.size()));
+    for (const HalfLifeModelSequenceGroup& seqGrp : mSequenceGroups) {
+        WriteCacheString(stream, seqGrp.label);
+        WriteCacheString(stream, seqGrp.name);
+        stream.WriteI32(seqGrp.data);
+    }
 
-const HalfLifeModelBoneController& HalfLifeModel::GetBoneController(const size_t idx) const {
-    return mBoneControllers[idx];
-}
+    stream.WriteU32(scast<uint32_t>(mSequences.size()));
+    for (size_t i = 0; i < mSequences.size(); ++i) {
+        const SequencePtr& sequence = mSequences[i];
+        WriteCacheString(stream, sequence->GetName());
+        stream.WriteF32(sequence->GetFPS());
+        stream.WriteU32(sequence->GetMotionType());
+        stream.WriteU32(sequence->GetMotionBone());
+        stream.WriteU32(sequence->GetSequenceGroup());
+        stream.WriteU32(sequence->GetFramesCount());
+        stream.WriteStruct(sequence->GetBounds());
+        stream.WriteU64(scast<uint64_t>(mSequencesAnimOffset[i]));
+
+        stream.WriteU32(scast<uint32_t>(sequence->GetEventsCount()));
+        for (size_t j = 0; j < sequence->GetEventsCount(); ++j) {
+            const HalfLifeModelAnimEvent& event = sequence->GetEvent(j);
+            stream.WriteU32(event.frame);
+            stream.WriteU32(event.event);
+            stream.WriteU32(event.type);
+            WriteCacheString(stream, event.options);
+        }
 
-void HalfLifeModel::SetBoneControllerValue(const size_t idx, const float value) {
-    mBoneControllerValues[idx] = value;
-}
+        // raw RLE block, same source lookup as the loading code does
+        const size_t groupIdx = sequence->GetSequenceGroup();
+        const MemStream* source = nullptr;
+        size_t offsetAnim = mSequencesAnimOffset[i];
+        if (groupIdx == 0) {
+            source = &mModelStream;
+            offsetAnim += scast<size_t>(mSequenceGroups[0].data);
+        } else if (groupIdx < seqGroupsFiles.size() && seqGroupsFiles[groupIdx]) {
+            source = &seqGroupsFiles[groupIdx];
+        }
 
-float HalfLifeModel::GetBoneControllerValue(const size_t idx) {
-    const HalfLifeModelBoneController& controller = this->GetBoneController(idx);
-    return controller.IsRotation() ? Deg2Rad(mBoneControllerValues[idx]) : mBoneControllerValues[idx];
-}
+        const uint8_t* animBegin = nullptr;
+        const uint8_t* animEnd = nullptr;
+        if (source != nullptr) {
+            const ArrayView<mstudioanim_t> anims = source->GetView<mstudioanim_t>(offsetAnim, mBones.size());
+            if (!anims.empty() && anims.size() == mBones.size()) {
+                animBegin = rcast<const uint8_t*>(anims.data());
+                animEnd = FindAnimDataEnd(anims.data(), anims.size(), sequence->GetFramesCount(), source->Data() + source->Length());
+                if (!animEnd) {
+                    // we can't tell how much data the decoder would read, better not to cache such a model at all
+                    return;
+                }
+            }
+        }
+        WriteCacheArray(stream, animBegin, animEnd ? scast<size_t>(animEnd - animBegin) : 0);
+    }
 
-size_t HalfLifeModel::GetTexturesCount() const {
-    return mTextures.size();
-}
+    // attachments and hitboxes
+    stream.WriteU32(scast<uint32_t>(mAttachments.size()));
+    for (const HalfLifeModelAttachment& attachment : mAttachments) {
+        WriteCacheString(stream, attachment.name);
+        stream.WriteI32(attachment.type);
+        stream.WriteI32(attachment.bone);
+        stream.WriteStruct(attachment.origin);
+        stream.WriteStruct(attachment.vectors);
+    }
 
-const HalfLifeModelTexture& HalfLifeModel::GetTexture(const size_t idx) const {
-    return mTextures[idx];
-}
+    stream.WriteU32(scast<uint32_t>(mHitBoxes.size()));
+    for (const HalfLifeModelHitBox& hitbox : mHitBoxes) {
+        stream.WriteStruct(hitbox);
+    }
 
-size_t HalfLifeModel::GetSkinsCount() const {
-    return mSkins.size();
+    stream.WriteU32(kCacheMagic);
+
+    HLCacheHeader header = {};
+    header.magic = kCacheMagic;
+    header.version = kCacheVersion;
+    header.layout = kCacheLayout;
+    header.payloadSize = scast<uint64_t>(stream.Length() - sizeof(HLCacheHeader));
+    header.payloadHash = HashBytes(stream.Data() + sizeof(HLCacheHeader), stream.Length() - sizeof(HLCacheHeader));
+    std::memcpy(stream.Data(), &header, sizeof(header));
+
+    // a file bigger than the whole budget would just push everything else out and be deleted by the next writer
+    const size_t budget = mLoadOptions.cacheDirBudget;
+    if (budget && stream.Length() > budget) {
+        return;
+    }
+
+    // write aside and swap, so readers never see a half written file
+    std::error_code ec;
+    fs::create_directories(cachePath.parent_path(), ec);
+
+    const fs::path tempPath = MakeCacheTempPath(cachePath);
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return;
+        }
+        file.write(rcast<const char*>(stream.Data()), scast<std::streamsize>(stream.Length()));
+        if (!file.good()) {
+            file.close();
+            fs::remove(tempPath, ec);
+            return;
+        }
+    }
+
+    fs::rename(tempPath, cachePath, ec);
+    if (ec) {
+        fs::remove(tempPath, ec);
+        return;
+    }
+
+    TrimCacheFolder(cachePath.parent_path(), budget, cachePath);
 }
 
-void HalfLifeModel::SetActiveSkin(const size_t skinIdx) {
-    mActiveSkin = skinIdx;
+
+/////////////////////
+
+HalfLifeModelInstance::HalfLifeModelInstance(const RefPtr<const HalfLifeModel>& model)
+    : mModel(model)
+    , mActiveSkin(0)
+    , mPoseSequence(0)
+    , mPoseFrameStep(0)
+    , mPoseDirty(true)
+    , mPoseVersion(0)
+    , mDrawListDirty(true)
+{
+    mActiveBodyPartSubModel.resize(mModel->GetBodyPartsCount(), 0);
+    mBoneControllerValues.resize(mModel->GetBoneControllersCount(), 0.0f);
+    mSkeleton.resize(mModel->GetBonesCount(), mat4f::identity());
+}
+HalfLifeModelInstance::~HalfLifeModelInstance() {
 }
 
-size_t HalfLifeModel::GetActiveSkin() const {
-    return mActiveSkin;
+const HalfLifeModel* HalfLifeModelInstance::GetModel() const {
+    return mModel.get();
 }
 
-size_t HalfLifeModel::GetSkinTexture(const size_t textureIdx) const {
-    const HalfLifeModelSkin& skin = mSkins[mActiveSkin];
-    if (textureIdx < skin.remapTable.size()) {
-        return skin.remapTable[textureIdx];
-    } else {
-        return textureIdx;
+void HalfLifeModelInstance::SetBodyPartActiveSubModel(const size_t bodyPartIdx, const size_t subModelIdx) {
+    if (mActiveBodyPartSubModel[bodyPartIdx] != subModelIdx) {
+        mActiveBodyPartSubModel[bodyPartIdx] = subModelIdx;
+        mDrawListDirty = true;
     }
 }
 
-const AABBox& HalfLifeModel::GetBounds() const {
-    return mBounds;
+size_t HalfLifeModelInstance::GetBodyPartActiveSubModel(const size_t bodyPartIdx) const {
+    return mActiveBodyPartSubModel[bodyPartIdx];
 }
 
-size_t HalfLifeModel::GetSequencesCount() const {
-    return mSequences.size();
+void HalfLifeModelInstance::SetBoneControllerValue(const size_t idx, const float value) {
+    if (mBoneControllerValues[idx] != value) {
+        mBoneControllerValues[idx] = value;
+        mPoseDirty = true;
+    }
 }
 
-HalfLifeModelSequence* HalfLifeModel::GetSequence(const size_t idx) const {
-    return mSequences[idx].get();
+float HalfLifeModelInstance::GetBoneControllerValue(const size_t idx) const {
+    return mBoneControllerValues[idx];
 }
 
-size_t HalfLifeModel::GetAttachmentsCount() const {
-    return mAttachments.size();
+void HalfLifeModelInstance::SetActiveSkin(const size_t skinIdx) {
+    if (mActiveSkin != skinIdx) {
+        mActiveSkin = skinIdx;
+        mDrawListDirty = true;
+    }
 }
 
-const HalfLifeModelAttachment& HalfLifeModel::GetAttachment(const size_t idx) const {
-    return mAttachments[idx];
+size_t HalfLifeModelInstance::GetActiveSkin() const {
+    return mActiveSkin;
 }
 
-size_t HalfLifeModel::GetHitBoxesCount() const {
-    return mHitBoxes.size();
+size_t HalfLifeModelInstance::GetSkinTexture(const size_t textureIdx) const {
+    return mModel->GetSkinTexture(mActiveSkin, textureIdx);
 }
 
-const HalfLifeModelHitBox& HalfLifeModel::GetHitBox(const size_t idx) const {
-    return mHitBoxes[idx];
+ArrayView<HalfLifeModelDrawCall> HalfLifeModelInstance::GetBodyPartDrawCalls(const size_t bodyPartIdx) const {
+    if (mDrawListDirty) {
+        this->RebuildDrawList();
+    }
+
+    const size_t start = mBodyPartDrawCallsStart[bodyPartIdx];
+    return ArrayView<HalfLifeModelDrawCall>(mDrawCalls.data() + start, mBodyPartDrawCallsStart[bodyPartIdx + 1] - start);
 }
 
-void HalfLifeModel::CalculateSkeleton(const float frame, const size_t sequenceIdx) {
-    if (!mBones.empty() && !mSequences.empty()) {
-        const SequencePtr& sequence = mSequences[sequenceIdx];
-
-        const uint32_t motionType = sequence->GetMotionType();
-        const uint32_t motionBone = sequence->GetMotionBone();
-
-        const uint32_t frameA = scast<uint32_t>(Floori(frame)) % sequence->GetFramesCount();
-        const uint32_t frameB = (frameA + 1u) % sequence->GetFramesCount();
-        const float frameLerp = frame - scast<float>(frameA);
-
-        for (size_t boneIdx = 0, numBones = mBones.size(); boneIdx < numBones; ++boneIdx) {
-            vec3f pos;
-            quatf rot;
-
-            const HalfLifeModelBone& bone = mBones[boneIdx];
-            const HalfLifeModelAnimLine& animLine = sequence->GetAnimLine(boneIdx);
-            if (!animLine.frames.empty()) {
-                const HalfLifeModelAnimFrame& valueA = animLine.frames[frameA];
-                const HalfLifeModelAnimFrame& valueB = animLine.frames[frameB];
-
-                vec3f offsetA(scast<float>(valueA.offset[0]) * bone.scalePos.x,
-                              scast<float>(valueA.offset[1]) * bone.scalePos.y,
-                              scast<float>(valueA.offset[2]) * bone.scalePos.z);
-                vec3f offsetB(scast<float>(valueB.offset[0]) * bone.scalePos.x,
-                              scast<float>(valueB.offset[1]) * bone.scalePos.y,
-                              scast<float>(valueB.offset[2]) * bone.scalePos.z);
-
-                vec3f rotationA(scast<float>(valueA.rotation[0]) * bone.scaleRot.x,
-                                scast<float>(valueA.rotation[1]) * bone.scaleRot.y,
-                                scast<float>(valueA.rotation[2]) * bone.scaleRot.z);
-                vec3f rotationB(scast<float>(valueB.rotation[0]) * bone.scaleRot.x,
-                                scast<float>(valueB.rotation[1]) * bone.scaleRot.y,
-                                scast<float>(valueB.rotation[2]) * bone.scaleRot.z);
-
-                // add bone controllers to the pos if any
-                if (bone.controllerIdx[0] >= 0) {
-                    offsetA.x += this->GetBoneControllerValue(scast<size_t>(bone.controllerIdx[0]));
-                    offsetB.x += this->GetBoneControllerValue(scast<size_t>(bone.controllerIdx[0]));
-                }
-                if (bone.controllerIdx[1] >= 0) {
-                    offsetA.y += this->GetBoneControllerValue(scast<size_t>(bone.controllerIdx[1]));
-                    offsetB.y += this->GetBoneControllerValue(scast<size_t>(bone.controllerIdx[1]));
-                }
-                if (bone.controllerIdx[2] >= 0) {
-                    offsetA.z += this->GetBoneControllerValue(scast<size_t>(bone.controllerIdx[2]));
-                    offsetB.z += this->GetBoneControllerValue(scast<size_t>(bone.controllerIdx[2]));
-                }
+// meshes of a submodel lie back to back in its indices, so the merged ones are just a longer range
+void HalfLifeModelInstance::RebuildDrawList() const {
+    const size_t numBodyParts = mModel->GetBodyPartsCount();
 
-                // add bone controllers to the rotation if any
-                if (bone.controllerIdx[3] >= 0) {
-                    rotationA.x += this->GetBoneControllerValue(scast<size_t>(bone.controllerIdx[3]));
-                    rotationB.x += this->GetBoneControllerValue(scast<size_t>(bone.controllerIdx[3]));
-                }
-                if (bone.controllerIdx[4] >= 0) {
-                    rotationA.y += this->GetBoneControllerValue(scast<size_t>(bone.controllerIdx[4]));
-                    rotationB.y += this->GetBoneControllerValue(scast<size_t>(bone.controllerIdx[4]));
-                }
-                if (bone.controllerIdx[5] >= 0) {
-                    rotationA.z += this->GetBoneControllerValue(scast<size_t>(bone.controllerIdx[5]));
-                    rotationB.z += this->GetBoneControllerValue(scast<size_t>(bone.controllerIdx[5]));
-                }
+    mDrawCalls.clear();
+    mBodyPartDrawCallsStart.resize(numBodyParts + 1);
+    for (size_t i = 0; i < numBodyParts; ++i) {
+        mBodyPartDrawCallsStart[i] = mDrawCalls.size();
 
-                pos = bone.pos + Lerp(offsetA, offsetB, frameLerp);
-                rot = quatf::slerp(quatf::fromEuler(bone.rot + rotationA), quatf::fromEuler(bone.rot + rotationB), frameLerp);
+        const HalfLifeModelBodypart* bodyPart = mModel->GetBodyPart(i);
+        if (mActiveBodyPartSubModel[i] >= bodyPart->GetStudioModelsCount()) {
+            continue;
+        }
 
-                if (motionBone == boneIdx) {
-                    if (motionType & STUDIO_X) {
-                        pos.x = 0.0f;
-                    }
-                    if (motionType & STUDIO_Y) {
-                        pos.y = 0.0f;
-                    }
-                    if (motionType & STUDIO_Z) {
-                        pos.z = 0.0f;
-                    }
+        const HalfLifeModelStudioModel* smdl = bodyPart->GetStudioModel(mActiveBodyPartSubModel[i]);
+        for (size_t k = 0; k < smdl->GetMeshesCount(); ++k) {
+            const HalfLifeModelStudioMesh& mesh = smdl->GetMesh(k);
+            const uint32_t textureIdx = scast<uint32_t>(this->GetSkinTexture(mesh.textureIndex));
+
+            if (mDrawCalls.size() > mBodyPartDrawCallsStart[i]) {
+                HalfLifeModelDrawCall& last = mDrawCalls.back();
+                if (last.textureIdx == textureIdx && last.indicesOffset + last.numIndices == mesh.indicesOffset) {
+                    last.numIndices += mesh.numIndices;
+                    last.numMeshes++;
+                    continue;
                 }
-            } else {
-                pos = bone.pos;
-                rot = quatf::fromEuler(bone.rot);
             }
 
-            mat4f& boneMat = mSkeleton[boneIdx];
-            boneMat = mat4f::fromQuatAndPos(rot, pos);
-            if (bone.parentIdx >= 0) {
-                boneMat = mSkeleton[bone.parentIdx] * boneMat;
-            }
+            mDrawCalls.push_back({ mesh.indicesOffset, mesh.numIndices, textureIdx, 1 });
         }
     }
+    mBodyPartDrawCallsStart[numBodyParts] = mDrawCalls.size();
+
+    mDrawListDirty = false;
 }
 
-void HalfLifeModel::LoadSequenceAnim(SequencePtr& sequence, MemStream& stream, const size_t offsetAnim) {
-    MemStream animStream = stream.Substream(offsetAnim, stream.Length());
-    const mstudioanim_t* animPtr = rcast<const mstudioanim_t*>(animStream.GetDataAtCursor());
+const mat4f& HalfLifeModelInstance::GetBoneMat(const size_t idx) const {
+    return mSkeleton[idx];
+}
 
-    const uint32_t numFrames = sequence->GetFramesCount();
+// the pose is keyed by the pair of frames it blends and the blend snapped down to 1/kPoseFrameSteps, so a paused or slowly
+// played animation doesn't recalculate the same pose over and over, and a single frame sequence never does
+void HalfLifeModelInstance::CalculateSkeleton(const float frame, const size_t sequenceIdx) {
+    const uint32_t numFrames = (sequenceIdx < mModel->GetSequencesCount()) ? mModel->GetSequence(sequenceIdx)->GetFramesCount() : 0;
 
-    for (size_t boneIdx = 0, numBones = mBones.size(); boneIdx < numBones; ++boneIdx, ++animPtr) {
-        const HalfLifeModelBone& bone = mBones[boneIdx];
+    int64_t frameStep = 0;
+    if (numFrames > 1) {
+        const int wholeFrame = Floori(frame);
+        const int64_t frameA = ((scast<int64_t>(wholeFrame) % numFrames) + numFrames) % numFrames;
+        const int64_t blendStep = scast<int64_t>(Floori((frame - scast<float>(wholeFrame)) * scast<float>(kPoseFrameSteps)));
+        frameStep = frameA * kPoseFrameSteps + std::min<int64_t>(blendStep, kPoseFrameSteps - 1);
+    }
 
-        HalfLifeModelAnimLine animLine;
-        animLine.frames.resize(numFrames);
-        for (int frame = 0; frame < scast<int>(numFrames); ++frame) {
-            HalfLifeModelAnimFrame& animFrame = animLine.frames[frame];
+    if (!mPoseDirty && mPoseSequence == sequenceIdx && mPoseFrameStep == frameStep) {
+        return;
+    }
 
-            animFrame.offset[0] = DecodeAnimValue(animPtr, frame, 0);
-            animFrame.offset[1] = DecodeAnimValue(animPtr, frame, 1);
-            animFrame.offset[2] = DecodeAnimValue(animPtr, frame, 2);
-            animFrame.rotation[0] = DecodeAnimValue(animPtr, frame, 3);
-            animFrame.rotation[1] = DecodeAnimValue(animPtr, frame, 4);
-            animFrame.rotation[2] = DecodeAnimValue(animPtr, frame, 5);
-        }
+    mModel->CalculateSkeleton(scast<float>(frameStep) / scast<float>(kPoseFrameSteps), sequenceIdx, mBoneControllerValues.data(), mSkeleton.data());
 
-        sequence->SetAnimLine(boneIdx, animLine);
-    }
+    mPoseSequence = sequenceIdx;
+    mPoseFrameStep = frameStep;
+    mPoseDirty = false;
+    ++mPoseVersion;
+}
+
+uint64_t HalfLifeModelInstance::GetPoseVersion() const {
+    return mPoseVersion;
 }
 
 
@@ -688,24 +2334,24 @@ HalfLifeModelBodypart::HalfLifeModelBodypart()
 HalfLifeModelBodypart::~HalfLifeModelBodypart()
 {}
 
-void HalfLifeModelBodypart::SetName(const CharString& name) {
+void HalfLifeModelBodypart::SetName(const StringView& name) {
     mName = name;
 }
 
-const CharString& HalfLifeModelBodypart::GetName() const {
+const StringView& HalfLifeModelBodypart::GetName() const {
     return mName;
 }
 
-void HalfLifeModelBodypart::AddStudioModel(const HalfLifeModelBodypart::StudioModelPtr& smdl) {
-    mModels.push_back(smdl);
+void HalfLifeModelBodypart::SetStudioModels(const ArrayView<HalfLifeModelBodypart::StudioModelPtr>& models) {
+    mModels = models;
 }
 
 size_t HalfLifeModelBodypart::GetStudioModelsCount() const {
     return mModels.size();
 }
 
-HalfLifeModelStudioModel* HalfLifeModelBodypart::GetStudioModel(const size_t idx) const {
-    return mModels[idx].get();
+const HalfLifeModelStudioModel* HalfLifeModelBodypart::GetStudioModel(const size_t idx) const {
+    return mModels[idx];
 }
 
 
@@ -721,11 +2367,11 @@ HalfLifeModelStudioModel::HalfLifeModelStudioModel()
 HalfLifeModelStudioModel::~HalfLifeModelStudioModel() {
 }
 
-void HalfLifeModelStudioModel::SetName(const CharString& name) {
+void HalfLifeModelStudioModel::SetName(const StringView& name) {
     mName = name;
 }
 
-const CharString& HalfLifeModelStudioModel::GetName() const {
+const StringView& HalfLifeModelStudioModel::GetName() const {
     return mName;
 }
 
@@ -745,7 +2391,7 @@ float HalfLifeModelStudioModel::GetBoundingRadius() const {
     return mBoundingRadius;
 }
 
-void HalfLifeModelStudioModel::SetVertices(const MyArray<HalfLifeModelVertex>& vertices) {
+void HalfLifeModelStudioModel::SetVertices(const ArrayView<HalfLifeModelVertex>& vertices) {
     mVertices = vertices;
 }
 
@@ -757,20 +2403,34 @@ const HalfLifeModelVertex* HalfLifeModelStudioModel::GetVertices() const {
     return mVertices.data();
 }
 
-void HalfLifeModelStudioModel::SetIndices(const MyArray<uint16_t>& indices) {
-    mIndices = indices;
+void HalfLifeModelStudioModel::SetIndices(const ArrayView<uint16_t>& indices) {
+    mIndices16 = indices;
+    mIndices32 = {};
+}
+
+void HalfLifeModelStudioModel::SetIndices(const ArrayView<uint32_t>& indices) {
+    mIndices16 = {};
+    mIndices32 = indices;
 }
 
 size_t HalfLifeModelStudioModel::GetIndicesCount() const {
-    return mIndices.size();
+    return mIndices32.empty() ? mIndices16.size() : mIndices32.size();
+}
+
+size_t HalfLifeModelStudioModel::GetIndexSize() const {
+    return mIndices32.empty() ? sizeof(uint16_t) : sizeof(uint32_t);
+}
+
+const void* HalfLifeModelStudioModel::GetIndicesData() const {
+    return mIndices32.empty() ? scast<const void*>(mIndices16.data()) : scast<const void*>(mIndices32.data());
 }
 
-const uint16_t* HalfLifeModelStudioModel::GetIndices() {
-    return mIndices.data();
+uint32_t HalfLifeModelStudioModel::GetIndex(const size_t idx) const {
+    return mIndices32.empty() ? mIndices16[idx] : mIndices32[idx];
 }
 
-void HalfLifeModelStudioModel::AddMesh(const HalfLifeModelStudioMesh& mesh) {
-    mMeshes.push_back(mesh);
+void HalfLifeModelStudioModel::SetMeshes(const ArrayView<HalfLifeModelStudioMesh>& meshes) {
+    mMeshes = meshes;
 }
 
 size_t HalfLifeModelStudioModel::GetMeshesCount() const {
@@ -783,17 +2443,67 @@ const HalfLifeModelStudioMesh& HalfLifeModelStudioModel::GetMesh(const size_t id
 
 
 
-HalfLifeModelSequence::HalfLifeModelSequence(const size_t numBones) {
-    mAnimLines.resize(numBones);
+// every bone of a sequence falls into exactly one run, runs are evaluated one after another with no per-bone decisions
+// and then the bones are concatenated with their parents in the bones order
+struct HalfLifeModelSequence::SkeletonProgram {
+    struct StaticBone {
+        mat4f       local;
+        quatf       rot;            // what the local matrix is made of, for baking
+        vec3f       pos;
+        uint32_t    boneIdx;
+    };
+
+    struct Control {
+        uint32_t    channel;        // X, Y, Z, XR, YR, ZR
+        uint32_t    controllerIdx;
+        float       scale;          // user set values of rotation controllers are in degrees
+    };
+
+    struct BoneOp {
+        uint32_t    boneIdx;
+        uint32_t    firstControl;
+        uint32_t    numControls;
+    };
+
+    struct Link {
+        uint32_t    boneIdx;
+        uint32_t    parentIdx;
+    };
+
+    MyArray<StaticBone>     staticBones;        // bind pose or constant channels, the local matrix is ready
+    MyArray<BoneOp>         rotationBones;      // animated, precomputed rotations
+    MyArray<BoneOp>         eulerBones;         // animated, rotations built from the angles
+    MyArray<BoneOp>         controlledBones;    // moved by bone controllers
+    MyArray<BoneOp>         motionBones;        // the motion bone, if the sequence moves along any axis
+    MyArray<Control>        controls;
+    MyArray<Link>           links;
+};
+
+HalfLifeModelSequence::HalfLifeModelSequence(MemArena& arena, const ArrayView<HalfLifeModelBone>& bones, const ArrayView<HalfLifeModelBoneController>& boneControllers, const bool precomputeRotations)
+    : mAnimData(nullptr)
+    , mAnimDecoded(false)
+    , mAnimHasFrames(false)
+    , mNumBones(bones.size())
+    , mBones(bones.data())
+    , mBoneControllers(boneControllers.data())
+    , mNumBoneControllers(boneControllers.size())
+    , mPrecomputeRotations(precomputeRotations)
+    , mAnimLines(arena.AllocArray<HalfLifeModelAnimLine>(bones.size()))
+    , mAnimWords(nullptr)
+    , mAnimWordsCount(0)
+    , mAnimRotations(nullptr)
+    , mAnimRotationsCount(0)
+    , mSkeletonProgramSize(0)
+{
 }
 HalfLifeModelSequence::~HalfLifeModelSequence() {
 }
 
-void HalfLifeModelSequence::SetName(const CharString& name) {
+void HalfLifeModelSequence::SetName(const StringView& name) {
     mName = name;
 }
 
-const CharString& HalfLifeModelSequence::GetName() const {
+const StringView& HalfLifeModelSequence::GetName() const {
     return mName;
 }
 
@@ -845,16 +2555,370 @@ const AABBox& HalfLifeModelSequence::GetBounds() const {
     return mBounds;
 }
 
-void HalfLifeModelSequence::SetAnimLine(const size_t boneIdx, const HalfLifeModelAnimLine& animLine) {
-    mAnimLines[boneIdx] = animLine;
+void HalfLifeModelSequence::SetAnimData(const mstudioanim_t* animData) {
+    mAnimData = animData;
+}
+
+bool HalfLifeModelSequence::HasAnimData() const {
+    return mAnimData != nullptr;
+}
+
+bool HalfLifeModelSequence::IsAnimDecoded() const {
+    return mAnimDecoded;
+}
+
+// with `arena` the packed frames go there (for good), otherwise to mAnimBits
+void HalfLifeModelSequence::DecodeAnim(MemArena* arena) const {
+    MyArray<uint32_t>().swap(mAnimBits);
+    mAnimWords = nullptr;
+    mAnimWordsCount = 0;
+    MyArray<HalfLifeModelPackedQuat>().swap(mAnimRotationsData);
+    mAnimRotations = nullptr;
+    mAnimRotationsCount = 0;
+    mAnimHasFrames = (mAnimData != nullptr && mNumFrames > 0);
+
+    if (mAnimHasFrames) {
+        MyArray<int16_t> values(mNumFrames);
+        MyArray<uint32_t> animBits;
+
+        const mstudioanim_t* animPtr = mAnimData;
+        for (size_t boneIdx = 0; boneIdx < mNumBones; ++boneIdx, ++animPtr) {
+            HalfLifeModelAnimLine& animLine = mAnimLines[boneIdx];
+            animLine.rotationOffset = 0;
+            animLine.rotationFrames = 0;
+            for (size_t channel = 0; channel < kAnimFrameStride; ++channel) {
+                HalfLifeModelAnimChannel& animChannel = animLine.channels[channel];
+                animChannel = {};
+
+                if (!animPtr->offset[channel]) {
+                    continue;
+                }
+
+                DecodeAnimChannel(animPtr, channel, mNumFrames, values.data(), 1);
+
+                const auto minMax = std::minmax_element(values.begin(), values.end());
+                const uint32_t range = scast<uint32_t>(scast<int32_t>(*minMax.second) - scast<int32_t>(*minMax.first));
+                animChannel.base = *minMax.first;
+                while ((range >> animChannel.bits) != 0) {
+                    ++animChannel.bits;
+                }
+
+                if (animChannel.bits > 0) {
+                    const size_t numWords = (scast<size_t>(mNumFrames) * animChannel.bits + 31) / 32;
+                    animChannel.wordOffset = scast<uint32_t>(animBits.size());
+                    animBits.resize(animBits.size() + numWords, 0);
+
+                    uint32_t* words = animBits.data() + animChannel.wordOffset;
+                    for (size_t frame = 0, bitPos = 0; frame < mNumFrames; ++frame, bitPos += animChannel.bits) {
+                        const uint64_t packed = scast<uint64_t>(scast<int32_t>(values[frame]) - animChannel.base) << (bitPos & 31);
+                        words[bitPos >> 5] |= scast<uint32_t>(packed);
+                        if ((bitPos & 31) + animChannel.bits > 32) {
+                            words[(bitPos >> 5) + 1] |= scast<uint32_t>(packed >> 32);
+                        }
+                    }
+                }
+            }
+        }
+
+        // one extra word so that sampling can always read two words at once
+        animBits.push_back(0);
+
+        // rotations exactly as CalculateSkeleton would build them from the Euler angles, except for the bones
+        // rotated by controllers, their angles change after decoding
+        MyArray<HalfLifeModelPackedQuat> rotations;
+        if (mPrecomputeRotations) {
+            for (size_t boneIdx = 0; boneIdx < mNumBones; ++boneIdx) {
+                const HalfLifeModelBone& bone = mBones[boneIdx];
+                if (bone.controllerIdx[3] >= 0 || bone.controllerIdx[4] >= 0 || bone.controllerIdx[5] >= 0) {
+                    continue;
+                }
+
+                HalfLifeModelAnimLine& animLine = mAnimLines[boneIdx];
+                const HalfLifeModelAnimChannel* rotationChannels = animLine.channels + 3;
+                const bool constant = !rotationChannels[0].bits && !rotationChannels[1].bits && !rotationChannels[2].bits;
+                animLine.rotationOffset = scast<uint32_t>(rotations.size());
+                animLine.rotationFrames = constant ? 1u : mNumFrames;
+                for (uint32_t frame = 0; frame < animLine.rotationFrames; ++frame) {
+                    const vec3f rotation(scast<float>(SampleAnimChannel(rotationChannels[0], animBits.data(), frame)) * bone.scaleRot.x,
+                                         scast<float>(SampleAnimChannel(rotationChannels[1], animBits.data(), frame)) * bone.scaleRot.y,
+                                         scast<float>(SampleAnimChannel(rotationChannels[2], animBits.data(), frame)) * bone.scaleRot.z);
+                    rotations.push_back(PackQuat(quatf::fromEuler(bone.rot + rotation)));
+                }
+            }
+        }
+
+        mAnimWordsCount = animBits.size();
+        mAnimRotationsCount = rotations.size();
+        if (arena) {
+            mAnimWords = arena->CopyArray(animBits.data(), animBits.size()).data();
+            mAnimRotations = arena->CopyArray(rotations.data(), rotations.size()).data();
+        } else {
+            animBits.shrink_to_fit();
+            mAnimBits.swap(animBits);
+            mAnimWords = mAnimBits.data();
+            rotations.shrink_to_fit();
+            mAnimRotationsData.swap(rotations);
+            mAnimRotations = mAnimRotationsData.data();
+        }
+    } else {
+        std::fill(mAnimLines, mAnimLines + mNumBones, HalfLifeModelAnimLine{});
+    }
+
+    this->CompileSkeletonProgram();
+
+    mAnimDecoded = true;
+}
+
+// frames decoded into the arena stay there until the model goes, only the lazily decoded ones are freed
+void HalfLifeModelSequence::ReleaseAnim() {
+    MyArray<uint32_t>().swap(mAnimBits);
+    mAnimWords = nullptr;
+    mAnimWordsCount = 0;
+    MyArray<HalfLifeModelPackedQuat>().swap(mAnimRotationsData);
+    mAnimRotations = nullptr;
+    mAnimRotationsCount = 0;
+    mSkeletonProgram.reset();
+    mSkeletonProgramSize = 0;
+    mAnimHasFrames = false;
+    mAnimDecoded = false;
+}
+
+size_t HalfLifeModelSequence::GetAnimMemorySize() const {
+    // channels descriptors are always there, only the packed frames come and go
+    return mAnimWordsCount * sizeof(uint32_t) + mAnimRotationsCount * sizeof(HalfLifeModelPackedQuat) + mSkeletonProgramSize;
+}
+
+// bones without frames and bones with constant channels are fully evaluated here, the rest is sorted by what it takes to evaluate them
+// controllers are resolved here too, so the broken ones (non-existing controllers) are dropped once
+void HalfLifeModelSequence::CompileSkeletonProgram() const {
+    StrongPtr<SkeletonProgram> program = MakeStrongPtr<SkeletonProgram>();
+
+    const bool motionBoneMoves = (mMotionType & (STUDIO_X | STUDIO_Y | STUDIO_Z)) != 0;
+    for (uint32_t boneIdx = 0; boneIdx < scast<uint32_t>(mNumBones); ++boneIdx) {
+        const HalfLifeModelBone& bone = mBones[boneIdx];
+        const HalfLifeModelAnimLine& animLine = mAnimLines[boneIdx];
+
+        if (bone.parentIdx >= 0 && scast<size_t>(bone.parentIdx) < mNumBones) {
+            program->links.push_back({ boneIdx, scast<uint32_t>(bone.parentIdx) });
+        }
+
+        if (!mAnimHasFrames) {
+            const quatf rot = quatf::fromEuler(bone.rot);
+            program->staticBones.push_back({ mat4f::fromQuatAndPos(rot, bone.pos), rot, bone.pos, boneIdx });
+            continue;
+        }
+
+        SkeletonProgram::BoneOp op = { boneIdx, scast<uint32_t>(program->controls.size()), 0 };
+        for (uint32_t channel = 0; channel < kAnimFrameStride; ++channel) {
+            const int32_t controllerIdx = bone.controllerIdx[channel];
+            if (controllerIdx >= 0 && scast<size_t>(controllerIdx) < mNumBoneControllers) {
+                const float scale = mBoneControllers[controllerIdx].IsRotation() ? Deg2Rad(1.0f) : 1.0f;
+                program->controls.push_back({ channel, scast<uint32_t>(controllerIdx), scale });
+                op.numControls++;
+            }
+        }
+
+        bool constant = true;
+        for (const HalfLifeModelAnimChannel& animChannel : animLine.channels) {
+            constant = constant && !animChannel.bits;
+        }
+
+        if (motionBoneMoves && boneIdx == mMotionBone) {
+            program->motionBones.push_back(op);
+        } else if (op.numControls > 0) {
+            program->controlledBones.push_back(op);
+        } else if (constant) {
+            const vec3f pos = bone.pos + SampleAnimVector(animLine.channels, mAnimWords, 0, bone.scalePos);
+            const quatf rot = animLine.rotationFrames ? SamplePackedRotation(mAnimRotations, animLine, 0) :
+                                                        quatf::fromEuler(bone.rot + SampleAnimVector(animLine.channels + 3, mAnimWords, 0, bone.scaleRot));
+            program->staticBones.push_back({ mat4f::fromQuatAndPos(rot, pos), rot, pos, boneIdx });
+        } else if (animLine.rotationFrames) {
+            program->rotationBones.push_back(op);
+        } else {
+            program->eulerBones.push_back(op);
+        }
+    }
+
+    mSkeletonProgramSize = sizeof(SkeletonProgram) +
+                           program->staticBones.size() * sizeof(SkeletonProgram::StaticBone) +
+                           (program->rotationBones.size() + program->eulerBones.size() + program->controlledBones.size() + program->motionBones.size()) * sizeof(SkeletonProgram::BoneOp) +
+                           program->controls.size() * sizeof(SkeletonProgram::Control) +
+                           program->links.size() * sizeof(SkeletonProgram::Link);
+    mSkeletonProgram = std::move(program);
+}
+
+// local rotation and position of every animated bone, handed to `setLocal(boneIdx, rot, pos)`
+template <typename TSetLocal>
+void HalfLifeModelSequence::EvaluateAnimatedBones(const float frame, const float* controllerValues, TSetLocal&& setLocal) const {
+    const SkeletonProgram& program = *mSkeletonProgram;
+
+    uint32_t frameA, frameB;
+    float frameLerp;
+    SplitFrame(frame, mNumFrames, frameA, frameB, frameLerp);
+
+    for (const SkeletonProgram::BoneOp& op : program.rotationBones) {
+        const HalfLifeModelBone& bone = mBones[op.boneIdx];
+        const HalfLifeModelAnimLine& animLine = mAnimLines[op.boneIdx];
+
+        const vec3f offsetA = SampleAnimVector(animLine.channels, mAnimWords, frameA, bone.scalePos);
+        const vec3f offsetB = SampleAnimVector(animLine.channels, mAnimWords, frameB, bone.scalePos);
+        const quatf rot = BlendPrecomputedRotations(SamplePackedRotation(mAnimRotations, animLine, frameA),
+                                                    SamplePackedRotation(mAnimRotations, animLine, frameB), frameLerp);
+        setLocal(op.boneIdx, rot, bone.pos + Lerp(offsetA, offsetB, frameLerp));
+    }
+
+    for (const SkeletonProgram::BoneOp& op : program.eulerBones) {
+        const HalfLifeModelBone& bone = mBones[op.boneIdx];
+        const HalfLifeModelAnimLine& animLine = mAnimLines[op.boneIdx];
+
+        const vec3f offsetA = SampleAnimVector(animLine.channels, mAnimWords, frameA, bone.scalePos);
+        const vec3f offsetB = SampleAnimVector(animLine.channels, mAnimWords, frameB, bone.scalePos);
+        const vec3f rotationA = SampleAnimVector(animLine.channels + 3, mAnimWords, frameA, bone.scaleRot);
+        const vec3f rotationB = SampleAnimVector(animLine.channels + 3, mAnimWords, frameB, bone.scaleRot);
+        const quatf rot = quatf::slerp(quatf::fromEuler(bone.rot + rotationA), quatf::fromEuler(bone.rot + rotationB), frameLerp);
+        setLocal(op.boneIdx, rot, bone.pos + Lerp(offsetA, offsetB, frameLerp));
+    }
+
+    // controlled bones are few (a handful per model at most), so they all go the full way
+    auto calcControlledBone = [&](const SkeletonProgram::BoneOp& op, vec3f& pos, quatf& rot) {
+        const HalfLifeModelBone& bone = mBones[op.boneIdx];
+        const HalfLifeModelAnimLine& animLine = mAnimLines[op.boneIdx];
+
+        float controlled[kAnimFrameStride] = {};
+        for (uint32_t i = 0; i < op.numControls; ++i) {
+            const SkeletonProgram::Control& control = program.controls[op.firstControl + i];
+            controlled[control.channel] = controllerValues[control.controllerIdx] * control.scale;
+        }
+        const vec3f controlledPos(controlled[0], controlled[1], controlled[2]);
+        const vec3f controlledRot(controlled[3], controlled[4], controlled[5]);
+
+        const vec3f offsetA = SampleAnimVector(animLine.channels, mAnimWords, frameA, bone.scalePos) + controlledPos;
+        const vec3f offsetB = SampleAnimVector(animLine.channels, mAnimWords, frameB, bone.scalePos) + controlledPos;
+        pos = bone.pos + Lerp(offsetA, offsetB, frameLerp);
+
+        // bones with position controllers only still have their rotations precomputed
+        if (animLine.rotationFrames) {
+            rot = BlendPrecomputedRotations(SamplePackedRotation(mAnimRotations, animLine, frameA),
+                                            SamplePackedRotation(mAnimRotations, animLine, frameB), frameLerp);
+        } else {
+            const vec3f rotationA = SampleAnimVector(animLine.channels + 3, mAnimWords, frameA, bone.scaleRot) + controlledRot;
+            const vec3f rotationB = SampleAnimVector(animLine.channels + 3, mAnimWords, frameB, bone.scaleRot) + controlledRot;
+            rot = quatf::slerp(quatf::fromEuler(bone.rot + rotationA), quatf::fromEuler(bone.rot + rotationB), frameLerp);
+        }
+    };
+
+    for (const SkeletonProgram::BoneOp& op : program.controlledBones) {
+        vec3f pos;
+        quatf rot;
+        calcControlledBone(op, pos, rot);
+        setLocal(op.boneIdx, rot, pos);
+    }
+
+    for (const SkeletonProgram::BoneOp& op : program.motionBones) {
+        vec3f pos;
+        quatf rot;
+        calcControlledBone(op, pos, rot);
+        if (mMotionType & STUDIO_X) {
+            pos.x = 0.0f;
+        }
+        if (mMotionType & STUDIO_Y) {
+            pos.y = 0.0f;
+        }
+        if (mMotionType & STUDIO_Z) {
+            pos.z = 0.0f;
+        }
+        setLocal(op.boneIdx, rot, pos);
+    }
+}
+
+void HalfLifeModelSequence::CalculateSkeleton(const float frame, const float* controllerValues, mat4f* skeleton) const {
+    DebugAssert(mAnimDecoded);
+
+    // the poses are baked with the controllers at zero
+    bool useBakedPoses = !mBakedPoses.empty();
+    for (const SkeletonProgram::Control& control : mSkeletonProgram->controls) {
+        useBakedPoses = useBakedPoses && controllerValues[control.controllerIdx] == 0.0f;
+    }
+
+    if (!useBakedPoses) {
+        this->EvaluateSkeletonProgram(frame, controllerValues, skeleton);
+        return;
+    }
+
+    uint32_t frameA, frameB;
+    float frameLerp;
+    SplitFrame(frame, mNumFrames, frameA, frameB, frameLerp);
+
+    // blended the same way the precomputed rotations are, so the bones keep their shape and turn along arcs
+    const HalfLifeModelBakedBone* poseA = mBakedPoses.data() + scast<size_t>(frameA) * mNumBones;
+    const HalfLifeModelBakedBone* poseB = mBakedPoses.data() + scast<size_t>(frameB) * mNumBones;
+    for (size_t boneIdx = 0; boneIdx < mNumBones; ++boneIdx) {
+        skeleton[boneIdx] = mat4f::fromQuatAndPos(BlendPrecomputedRotations(poseA[boneIdx].rot, poseB[boneIdx].rot, frameLerp),
+                                                  Lerp(poseA[boneIdx].pos, poseB[boneIdx].pos, frameLerp));
+    }
+
+    for (const SkeletonProgram::Link& link : mSkeletonProgram->links) {
+        skeleton[link.boneIdx] = skeleton[link.parentIdx] * skeleton[link.boneIdx];
+    }
+}
+
+// poses are taken at the whole frames, exactly as the bones evaluate there
+bool HalfLifeModelSequence::BakePoses() const {
+    DebugAssert(mAnimDecoded);
+
+    if (!mAnimHasFrames) {
+        return false;
+    }
+
+    const MyArray<float> controllerValues(mNumBoneControllers, 0.0f);
+    MyArray<HalfLifeModelBakedBone> bakedPoses(scast<size_t>(mNumFrames) * mNumBones);
+    for (uint32_t frame = 0; frame < mNumFrames; ++frame) {
+        HalfLifeModelBakedBone* pose = bakedPoses.data() + scast<size_t>(frame) * mNumBones;
+        for (const SkeletonProgram::StaticBone& staticBone : mSkeletonProgram->staticBones) {
+            pose[staticBone.boneIdx] = { staticBone.rot, staticBone.pos };
+        }
+        this->EvaluateAnimatedBones(scast<float>(frame), controllerValues.data(), [pose](const uint32_t boneIdx, const quatf& rot, const vec3f& pos) {
+            pose[boneIdx] = { rot, pos };
+        });
+    }
+
+    mBakedPoses.swap(bakedPoses);
+    return true;
+}
+
+void HalfLifeModelSequence::ReleaseBakedPoses() {
+    MyArray<HalfLifeModelBakedBone>().swap(mBakedPoses);
+}
+
+bool HalfLifeModelSequence::HasBakedPoses() const {
+    return !mBakedPoses.empty();
 }
 
-const HalfLifeModelAnimLine& HalfLifeModelSequence::GetAnimLine(const size_t boneIdx) const {
-    return mAnimLines[boneIdx];
+size_t HalfLifeModelSequence::GetBakedPosesSize() const {
+    return mBakedPoses.size() * sizeof(HalfLifeModelBakedBone);
+}
+
+void HalfLifeModelSequence::EvaluateSkeletonProgram(const float frame, const float* controllerValues, mat4f* skeleton) const {
+    const SkeletonProgram& program = *mSkeletonProgram;
+
+    for (const SkeletonProgram::StaticBone& staticBone : program.staticBones) {
+        skeleton[staticBone.boneIdx] = staticBone.local;
+    }
+
+    // every other run is empty without frames
+    if (mAnimHasFrames) {
+        this->EvaluateAnimatedBones(frame, controllerValues, [skeleton](const uint32_t boneIdx, const quatf& rot, const vec3f& pos) {
+            skeleton[boneIdx] = mat4f::fromQuatAndPos(rot, pos);
+        });
+    }
+
+    for (const SkeletonProgram::Link& link : program.links) {
+        skeleton[link.boneIdx] = skeleton[link.parentIdx] * skeleton[link.boneIdx];
+    }
 }
 
-void HalfLifeModelSequence::SetEvents(MyArray<HalfLifeModelAnimEvent>& events) {
-    mEvents.swap(events);
+void HalfLifeModelSequence::SetEvents(const ArrayView<HalfLifeModelAnimEvent>& events) {
+    mEvents = events;
 }
 
 size_t HalfLifeModelSequence::GetEventsCount() const {
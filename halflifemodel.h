@@ -7,6 +7,7 @@
 class HalfLifeModelBodypart;
 class HalfLifeModelStudioModel;
 class HalfLifeModelSequence;
+class HalfLifeModelInstance;
 
 PACKED_STRUCT_BEGIN
 struct HalfLifeModelVertex {
@@ -23,19 +24,21 @@ struct HalfLifeModelVertex {
     }
 } PACKED_STRUCT_END;
 
+// pixels and palette are views into the model file memory
+// names here and below live in the model arena (or the cache file memory)
 struct HalfLifeModelTexture {
-    CharString          name;
+    StringView          name;
     uint32_t            width;
     uint32_t            height;
     bool                chrome;
     bool                additive;
     bool                masked;
-    MyArray<uint8_t>    data;
-    MyArray<uint8_t>    palette;
+    ArrayView<uint8_t>  data;
+    ArrayView<uint8_t>  palette;
 };
 
 struct HalfLifeModelSkin {
-    MyArray<uint16_t>   remapTable;
+    ArrayView<uint16_t> remapTable;
 };
 
 struct HalfLifeModelStudioMesh {
@@ -44,8 +47,16 @@ struct HalfLifeModelStudioMesh {
     uint32_t    textureIndex;
 };
 
+// consecutive meshes of a submodel that get the same texture (and so the same flags) with the active skin, drawn in one go
+struct HalfLifeModelDrawCall {
+    uint32_t    indicesOffset;
+    uint32_t    numIndices;
+    uint32_t    textureIdx;     // already remapped by the skin, broken models may have it out of the textures range
+    uint32_t    numMeshes;      // merged into this draw call
+};
+
 struct HalfLifeModelBone {
-    CharString  name;
+    StringView  name;
     int32_t     parentIdx;
     vec3f       pos;
     vec3f       rot;
@@ -71,7 +82,7 @@ struct HalfLifeModelBoneController {
 };
 
 struct HalfLifeModelAttachment {
-    CharString  name;
+    StringView  name;
     int32_t     type;
     int32_t     bone;
     vec3f       origin;
@@ -82,12 +93,12 @@ struct HalfLifeModelAnimEvent {
     uint32_t    frame;
     uint32_t    event;
     uint32_t    type;
-    CharString  options;
+    StringView  options;
 };
 
 struct HalfLifeModelSequenceGroup {
-    CharString  label;
-    CharString  name;   // file name
+    StringView  label;
+    StringView  name;   // file name
     int32_t     data;
 };
 
@@ -96,8 +107,29 @@ struct HalfLifeModelAnimFrame {
     int16_t rotation[3];
 };
 
+// all frames of a single channel of the bone animation
+// zero channels take no memory, constant ones keep just the value, the rest are bit-packed relative to their minimum
+struct HalfLifeModelAnimChannel {
+    int16_t     base;           // constant value or the minimum of the packed ones
+    uint16_t    bits;           // bits per packed value, 0 - every frame is `base`
+    uint32_t    wordOffset;     // first packed word in the sequence anim bits
+};
+
+// normalized rotation in 48 bits: the largest component is dropped, the other three get 15 bits each
+struct HalfLifeModelPackedQuat {
+    uint16_t    words[3];
+};
+
 struct HalfLifeModelAnimLine {
-    MyArray<HalfLifeModelAnimFrame> frames;
+    HalfLifeModelAnimChannel    channels[6];    // X, Y, Z, XR, YR, ZR, same as offset[3] + rotation[3] of the frame
+    uint32_t                    rotationOffset; // first precomputed rotation of the bone
+    uint32_t                    rotationFrames; // 0 - not precomputed, 1 - constant, all the frames otherwise
+};
+
+// local transform of a bone at a whole frame, relative to its parent
+struct HalfLifeModelBakedBone {
+    quatf                       rot;
+    vec3f                       pos;
 };
 
 struct HalfLifeModelHitBox {
@@ -106,50 +138,124 @@ struct HalfLifeModelHitBox {
     AABBox      bounds;
 };
 
+struct HalfLifeModelLoadOptions {
+    bool        lazySequences = false;                  // decode sequences animation on first use instead of on load
+    size_t      decodedAnimBudget = 64 * 1024 * 1024;   // bytes, least recently used sequences are released above it (lazy mode only), 0 - no limit
+    size_t      numThreads = 0;                         // worker threads used to decode the model, 0 - all hardware threads
+    bool        concurrentReads = true;                 // read the textures and sequence groups files alongside the main one and the parsing
+    bool        optimizeVertexCache = false;            // reorder triangles and vertices of the meshes for the GPU vertex cache and fetch locality
+    bool        precomputeRotations = false;            // turn the rotation channels into quaternions when decoding, skeletons skip the Euler angles then
+    size_t      bakedPosesBudget = 0;                   // bytes, sequences poses are baked on the first playback, least recently played ones are released above it, 0 - no baking
+    fs::path    cacheDir;                               // where post-processed models are cached (.hlmvcache), empty - no caching
+    size_t      cacheDirBudget = 0;                     // bytes, least recently used files of cacheDir are deleted above it after writing a new one, 0 - no limit
+    // called on the loading thread between the loading stages with progress in [0, 1], return false to cancel loading
+    std::function<bool(const float progress)>   progressCallback;
+};
+
+struct HalfLifeModelLoadStats {
+    float   readMs = 0.0f;          // reading (mapping) the model files
+    float   texturesMs = 0.0f;      // textures and skins
+    float   geometryMs = 0.0f;      // bodyparts and submodels expansion
+    float   sequencesMs = 0.0f;     // sequences headers, groups files and animation decoding
+    float   decodeMs = 0.0f;        // animation decoding alone, part of sequencesMs
+    float   cacheMs = 0.0f;         // cache validation and reading, or writing a new one
+    float   totalMs = 0.0f;
+    size_t  numThreads = 0;         // worker threads actually used
+    size_t  arenaBytes = 0;         // memory reserved by the model arena
+    bool    fromCache = false;      // model was restored from the cache, geometry and sequences parsing was skipped
+    float   acmrBefore = 0.0f;      // transformed vertices per triangle (16 entries FIFO cache) of the meshes as stored in the file
+    float   acmrAfter = 0.0f;       // and as they are drawn, same as acmrBefore without optimizeVertexCache
+};
+
+// what the fast scan gets out of a model, just the header and the names, see HalfLifeModel::ScanInfo
+struct HalfLifeModelInfoBodypart {
+    CharString          name;
+    MyArray<CharString> subModels;
+};
+
+struct HalfLifeModelInfoSequence {
+    CharString  name;
+    float       fps;
+    uint32_t    numFrames;
+    uint32_t    sequenceGroup;
+};
+
+struct HalfLifeModelInfoTexture {
+    CharString  name;
+    uint32_t    width;
+    uint32_t    height;
+};
+
+struct HalfLifeModelInfo {
+    CharString                          name;           // as stored in the header
+    uint32_t                            version = 0;
+    uint32_t                            flags = 0;
+    AABBox                              bounds;         // clipping box
+    size_t                              numSkins = 0;
+    size_t                              numAttachments = 0;
+    size_t                              numHitBoxes = 0;
+    MyArray<CharString>                 bones;
+    MyArray<HalfLifeModelInfoBodypart>  bodyParts;
+    MyArray<HalfLifeModelInfoSequence>  sequences;
+    MyArray<CharString>                 sequenceGroups; // file names
+    MyArray<HalfLifeModelInfoTexture>   textures;       // from the textures file (foot.mdl) if the model has none
+};
+
 class HalfLifeModel {
     static const uint32_t kIDSTMagic = MakeFourcc<'I','D','S','T'>();
     static const uint32_t kIDSQMagic = MakeFourcc<'I','D','S','Q'>();
 
-    using BodyPartPtr = RefPtr<HalfLifeModelBodypart>;
-    using SequencePtr = RefPtr<HalfLifeModelSequence>;
+    // owned by mArena
+    using BodyPartPtr = HalfLifeModelBodypart*;
+    using SequencePtr = HalfLifeModelSequence*;
 
 public:
     HalfLifeModel();
     ~HalfLifeModel();
 
+    HalfLifeModel&                          operator=(HalfLifeModel&& other) = default;
+
+    void                                    SetLoadOptions(const HalfLifeModelLoadOptions& options);
+    const HalfLifeModelLoadOptions&         GetLoadOptions() const;
+    const HalfLifeModelLoadStats&           GetLoadStats() const;
+
+    // textures (foot.mdl) and sequence groups (foo01.mdl) files, these are loaded along with their main model
+    static bool                             IsCompanionFile(const fs::path& filePath);
+    // metadata only, reads the header and the descriptors tables, no geometry, animation or texture pixels are touched
+    static bool                             ScanInfo(const fs::path& filePath, HalfLifeModelInfo& info);
+
     bool                                    LoadFromPath(const fs::path& filePath);
-    bool                                    LoadFromMemStream(MemStream& stream, const studiohdr_t& stdhdr);
+    bool                                    LoadFromMemStream(MemStream& srcStream, const studiohdr_t& stdhdr);
 
     void                                    LoadTextures(MemStream& stream, const size_t numTextures, const size_t texturesOffset);
     void                                    LoadSkins(MemStream& stream, const size_t numSkins, const size_t numTexturesPerSkin, const size_t skinsOffset);
 
     size_t                                  GetBodyPartsCount() const;
-    HalfLifeModelBodypart*                  GetBodyPart(const size_t idx) const;
-
-    void                                    SetBodyPartActiveSubModel(const size_t bodyPartIdx, const size_t subModelIdx);
-    size_t                                  GetBodyPartActiveSubModel(const size_t bodyPartIdx) const;
+    const HalfLifeModelBodypart*            GetBodyPart(const size_t idx) const;
 
     size_t                                  GetBonesCount() const;
     const HalfLifeModelBone&                GetBone(const size_t idx) const;
-    const mat4f&                            GetBoneMat(const size_t idx) const;
 
     size_t                                  GetBoneControllersCount() const;
     const HalfLifeModelBoneController&      GetBoneController(const size_t idx) const;
-    void                                    SetBoneControllerValue(const size_t idx, const float value);
-    float                                   GetBoneControllerValue(const size_t idx);
 
     size_t                                  GetTexturesCount() const;
     const HalfLifeModelTexture&             GetTexture(const size_t idx) const;
 
     size_t                                  GetSkinsCount() const;
-    void                                    SetActiveSkin(const size_t skinIdx);
-    size_t                                  GetActiveSkin() const;
-    size_t                                  GetSkinTexture(const size_t textureIdx) const;
+    size_t                                  GetSkinTexture(const size_t skinIdx, const size_t textureIdx) const;
 
     const AABBox&                           GetBounds() const;
 
     size_t                                  GetSequencesCount() const;
-    HalfLifeModelSequence*                  GetSequence(const size_t idx) const;
+    const HalfLifeModelSequence*            GetSequence(const size_t idx) const;
+    size_t                                  GetDecodedAnimSize() const;
+    size_t                                  GetBakedPosesSize() const;
+    // memory held by the model: mapped files, the arena, lazily decoded animation and baked poses
+    size_t                                  GetMemorySize() const;
+    // the .mdl and the textures and sequence groups files next to it, whether they exist or not
+    MyArray<fs::path>                       GetSourceFiles() const;
+    void                                    PreloadSequenceAnim(const size_t sequenceIdx) const;
 
     size_t                                  GetAttachmentsCount() const;
     const HalfLifeModelAttachment&          GetAttachment(const size_t idx) const;
@@ -157,46 +263,140 @@ public:
     size_t                                  GetHitBoxesCount() const;
     const HalfLifeModelHitBox&              GetHitBox(const size_t idx) const;
 
-    void                                    CalculateSkeleton(const float frame, const size_t sequenceIdx);
+    // `controllerValues` are as set by the user (degrees for rotations), one per bone controller, `skeleton` gets one matrix per bone
+    void                                    CalculateSkeleton(const float frame, const size_t sequenceIdx, const float* controllerValues, mat4f* skeleton) const;
 
 private:
-    void                                    LoadSequenceAnim(SequencePtr& sequence, MemStream& stream, const size_t offsetAnim);
+    struct VertexCacheStats {
+        size_t  numTriangles;
+        size_t  missesBefore;
+        size_t  missesAfter;
+    };
+
+    bool                                    LoadStudioModel(const MemStream& stream, const mstudiomodel_t& mdlHdr, HalfLifeModelStudioModel& smdl, AABBox& bounds, VertexCacheStats& vcacheStats);
+    void                                    LoadSequenceAnim(HalfLifeModelSequence* sequence, const MemStream& stream, const size_t offsetAnim) const;
+    void                                    TouchSequenceAnim(const size_t sequenceIdx) const;
+    std::shared_lock<std::shared_mutex>     LockSequenceAnim(const size_t sequenceIdx) const;
+    std::shared_lock<std::shared_mutex>     LockSequenceBake(const size_t sequenceIdx) const;
+    void                                    BakeSequencePoses(const size_t sequenceIdx) const;
+    MemStream                               LoadSequenceGroupFile(const size_t groupIdx) const;
+    static MemStream                        CheckSequenceGroupFile(MemStream seqStream);
+    void                                    StartSequenceGroupsReads(const MemStream& stream, const studiohdr_t& stdhdr);
+    MemStream                               TakeSequenceGroupFile(const size_t groupIdx);
+    bool                                    ReportLoadProgress(const float progress) const;
+    void                                    DecodeAllSequences();
+    fs::path                                GetCachePath(const fs::path& filePath) const;
+    bool                                    LoadFromCache(const fs::path& cachePath);
+    void                                    SaveToCache(const fs::path& cachePath) const;
 
 private:
+    // bodyparts, submodels, sequences, their geometry, events and all the names, released in one go with the model
+    // (lazily decoded animation stays on the heap, as it comes and goes with the budget)
+    MemArena                                mArena;
+    HalfLifeModelLoadOptions                mLoadOptions;
+    HalfLifeModelLoadStats                  mLoadStats;
     fs::path                                mSourcePath;
+    // textures, skins and anims are borrowed from these, so we keep them alive along with the model
+    // (when restored from the cache, mModelStream is the cache file)
+    MemStream                               mModelStream;
+    MemStream                               mTexturesStream;
+    // sequence groups files being read while the model is parsed, LoadFromPath starts them and LoadFromMemStream takes them
+    MyArray<std::future<MemStream>>         mSeqGroupsReads;
     MyArray<BodyPartPtr>                    mBodyParts;
-    MyArray<size_t>                         mActiveBodyPartSubModel;
     MyArray<HalfLifeModelTexture>           mTextures;
     MyArray<HalfLifeModelSkin>              mSkins;
-    size_t                                  mActiveSkin;
     MyArray<HalfLifeModelBone>              mBones;
     MyArray<HalfLifeModelBoneController>    mBoneControllers;
-    MyArray<float>                          mBoneControllerValues;
-    MyArray<mat4f>                          mSkeleton;
     AABBox                                  mBounds;
     MyArray<SequencePtr>                    mSequences;
+    MyArray<size_t>                         mSequencesAnimOffset;
     MyArray<HalfLifeModelSequenceGroup>     mSequenceGroups;
     MyArray<HalfLifeModelAttachment>        mAttachments;
     MyArray<HalfLifeModelHitBox>            mHitBoxes;
+
+    // lazy decoding and pose baking are the only things that change in a loaded model, they are kept aside (and behind a pointer, so the model stays movable)
+    // the locks are held shared while sampling a sequence and exclusively while decoding (baking) or evicting, `lock` always goes first
+    struct SequencesAnimState {
+        std::shared_mutex                   lock;
+        StrongPtr<std::atomic<uint64_t>[]>  lastUse;
+        std::atomic<uint64_t>               useCounter{ 0 };
+        std::atomic<size_t>                 decodedSize{ 0 };
+        MyArray<bool>                       groupsMissing;
+        std::shared_mutex                   bakeLock;
+        StrongPtr<std::atomic<uint64_t>[]>  bakeLastUse;
+        std::atomic<size_t>                 bakedSize{ 0 };
+        MyArray<bool>                       bakeRejected;   // nothing to bake or too big for the budget
+    };
+    StrongPtr<SequencesAnimState>           mAnimState;
+};
+
+// per-viewer state of a model: active submodels and skin, bone controllers and the calculated skeleton
+// the model itself is never changed, so any number of instances can share it and be animated on different threads
+class HalfLifeModelInstance {
+public:
+    static const uint32_t kPoseFrameSteps = 1024;   // the blend between two frames of a pose is snapped down to 1/kPoseFrameSteps
+
+    explicit HalfLifeModelInstance(const RefPtr<const HalfLifeModel>& model);
+    ~HalfLifeModelInstance();
+
+    const HalfLifeModel*                    GetModel() const;
+
+    void                                    SetBodyPartActiveSubModel(const size_t bodyPartIdx, const size_t subModelIdx);
+    size_t                                  GetBodyPartActiveSubModel(const size_t bodyPartIdx) const;
+
+    void                                    SetBoneControllerValue(const size_t idx, const float value);
+    float                                   GetBoneControllerValue(const size_t idx) const;
+
+    void                                    SetActiveSkin(const size_t skinIdx);
+    size_t                                  GetActiveSkin() const;
+    size_t                                  GetSkinTexture(const size_t textureIdx) const;
+
+    // draw calls of the bodypart's active submodel, the list is rebuilt only after the active submodels or the skin change
+    ArrayView<HalfLifeModelDrawCall>        GetBodyPartDrawCalls(const size_t bodyPartIdx) const;
+
+    const mat4f&                            GetBoneMat(const size_t idx) const;
+    // does nothing unless the sequence, the (wrapped and snapped) frame or the bone controllers changed since the last call
+    void                                    CalculateSkeleton(const float frame, const size_t sequenceIdx);
+    // changes every time the skeleton does, users of the bone matrices can keep their results while it stays the same
+    uint64_t                                GetPoseVersion() const;
+
+private:
+    void                                    RebuildDrawList() const;
+
+private:
+    RefPtr<const HalfLifeModel>             mModel;
+    MyArray<size_t>                         mActiveBodyPartSubModel;
+    size_t                                  mActiveSkin;
+    MyArray<float>                          mBoneControllerValues;
+    MyArray<mat4f>                          mSkeleton;
+    // what the skeleton was calculated for
+    size_t                                  mPoseSequence;
+    int64_t                                 mPoseFrameStep; // first frame of the blend * kPoseFrameSteps + the snapped blend
+    bool                                    mPoseDirty;     // never calculated yet or the controllers changed
+    uint64_t                                mPoseVersion;
+    // built on demand, for all the bodyparts at once
+    mutable MyArray<HalfLifeModelDrawCall>  mDrawCalls;
+    mutable MyArray<size_t>                 mBodyPartDrawCallsStart;    // one per bodypart plus the end
+    mutable bool                            mDrawListDirty;
 };
 
 class HalfLifeModelBodypart {
-    using StudioModelPtr = RefPtr<HalfLifeModelStudioModel>;
+    using StudioModelPtr = HalfLifeModelStudioModel*;
 
 public:
     HalfLifeModelBodypart();
     ~HalfLifeModelBodypart();
 
-    void                        SetName(const CharString& name);
-    const CharString&           GetName() const;
+    void                        SetName(const StringView& name);
+    const StringView&           GetName() const;
 
-    void                        AddStudioModel(const StudioModelPtr& smdl);
+    void                        SetStudioModels(const ArrayView<StudioModelPtr>& models);
     size_t                      GetStudioModelsCount() const;
-    HalfLifeModelStudioModel*   GetStudioModel(const size_t idx) const;
+    const HalfLifeModelStudioModel* GetStudioModel(const size_t idx) const;
 
 private:
-    CharString                  mName;
-    MyArray<StudioModelPtr>     mModels;
+    StringView                  mName;
+    ArrayView<StudioModelPtr>   mModels;
 };
 
 class HalfLifeModelStudioModel {
@@ -204,41 +404,49 @@ public:
     HalfLifeModelStudioModel();
     ~HalfLifeModelStudioModel();
 
-    void                                SetName(const CharString& name);
-    const CharString&                   GetName() const;
+    void                                SetName(const StringView& name);
+    const StringView&                   GetName() const;
     void                                SetType(const int type);
     int                                 GetType() const;
     void                                SetBoundingRadius(const float r);
     float                               GetBoundingRadius() const;
 
-    void                                SetVertices(const MyArray<HalfLifeModelVertex>& vertices);
+    // vertices, indices and meshes are not copied, the memory must outlive the submodel
+    void                                SetVertices(const ArrayView<HalfLifeModelVertex>& vertices);
     size_t                              GetVerticesCount() const;
     const HalfLifeModelVertex*          GetVertices() const;
 
-    void                                SetIndices(const MyArray<uint16_t>& indices);
+    // 16-bit indices unless the submodel has more vertices than they can address
+    void                                SetIndices(const ArrayView<uint16_t>& indices);
+    void                                SetIndices(const ArrayView<uint32_t>& indices);
     size_t                              GetIndicesCount() const;
-    const uint16_t*                     GetIndices();
+    size_t                              GetIndexSize() const;       // in bytes, 2 or 4
+    const void*                         GetIndicesData() const;
+    uint32_t                            GetIndex(const size_t idx) const;
 
-    void                                AddMesh(const HalfLifeModelStudioMesh& mesh);
+    void                                SetMeshes(const ArrayView<HalfLifeModelStudioMesh>& meshes);
     size_t                              GetMeshesCount() const;
     const HalfLifeModelStudioMesh&      GetMesh(const size_t idx) const;
 
 private:
-    CharString                          mName;
+    StringView                          mName;
     int                                 mType;
     float                               mBoundingRadius;
-    MyArray<HalfLifeModelVertex>        mVertices;
-    MyArray<uint16_t>                   mIndices;
-    MyArray<HalfLifeModelStudioMesh>    mMeshes;
+    ArrayView<HalfLifeModelVertex>      mVertices;
+    ArrayView<uint16_t>                 mIndices16;
+    ArrayView<uint32_t>                 mIndices32;     // only one of the two is set
+    ArrayView<HalfLifeModelStudioMesh>  mMeshes;
 };
 
 class HalfLifeModelSequence {
 public:
-    HalfLifeModelSequence(const size_t numBones);
+    // `bones` and `boneControllers` must outlive the sequence, they are compiled into the skeleton program on decode
+    // (with `precomputeRotations` into the rotations as well)
+    HalfLifeModelSequence(MemArena& arena, const ArrayView<HalfLifeModelBone>& bones, const ArrayView<HalfLifeModelBoneController>& boneControllers, const bool precomputeRotations);
     ~HalfLifeModelSequence();
 
-    void                            SetName(const CharString& name);
-    const CharString&               GetName() const;
+    void                            SetName(const StringView& name);
+    const StringView&               GetName() const;
     void                            SetFPS(const float fps);
     float                           GetFPS() const;
     void                            SetMotionType(const uint32_t motionType);
@@ -251,20 +459,67 @@ public:
     uint32_t                        GetSequenceGroup() const;
     void                            SetBounds(const AABBox& bounds);
     const AABBox&                   GetBounds() const;
-    void                            SetAnimLine(const size_t boneIdx, const HalfLifeModelAnimLine& animLine);
-    const HalfLifeModelAnimLine&    GetAnimLine(const size_t boneIdx) const;
-    void                            SetEvents(MyArray<HalfLifeModelAnimEvent>& events);
+    void                            SetAnimData(const mstudioanim_t* animData);
+    bool                            HasAnimData() const;
+    bool                            IsAnimDecoded() const;
+    size_t                          GetAnimMemorySize() const;
+    bool                            HasBakedPoses() const;
+    size_t                          GetBakedPosesSize() const;
+    void                            SetEvents(const ArrayView<HalfLifeModelAnimEvent>& events);
     size_t                          GetEventsCount() const;
     const HalfLifeModelAnimEvent&   GetEvent(const size_t idx) const;
 
 private:
-    CharString                      mName;
+    // the decoded frames and the baked poses come and go under the model's sequence locks, so only HalfLifeModel touches them
+    friend class HalfLifeModel;
+
+    void                            DecodeAnim(MemArena* arena = nullptr) const;
+    void                            ReleaseAnim();
+    // same as HalfLifeModel::CalculateSkeleton, the sequence must be decoded and the caller keeps the decoded frames
+    // (and the baked poses) from going away, HalfLifeModel does it with the sequence locks
+    void                            CalculateSkeleton(const float frame, const float* controllerValues, mat4f* skeleton) const;
+    // local poses of all the bones at every frame with the bone controllers at zero, from then on CalculateSkeleton just
+    // blends two of them and walks the hierarchy, unless some controller of the sequence is moved
+    // returns false if there's nothing to bake (no frames)
+    bool                            BakePoses() const;
+    void                            ReleaseBakedPoses();
+
+    struct SkeletonProgram;
+
+    void                            CompileSkeletonProgram() const;
+    void                            EvaluateSkeletonProgram(const float frame, const float* controllerValues, mat4f* skeleton) const;
+    template <typename TSetLocal>
+    void                            EvaluateAnimatedBones(const float frame, const float* controllerValues, TSetLocal&& setLocal) const;
+
+    StringView                      mName;
     float                           mFPS;
     uint32_t                        mMotionType;
     uint32_t                        mMotionBone;
     uint32_t                        mSequenceGroup;
     uint32_t                        mNumFrames;
     AABBox                          mBounds;
-    MyArray<HalfLifeModelAnimEvent> mEvents;
-    MyArray<HalfLifeModelAnimLine>  mAnimLines;
+    ArrayView<HalfLifeModelAnimEvent>   mEvents;
+    // raw RLE data, decoded into mAnimLines and mAnimWords on first request
+    const mstudioanim_t*            mAnimData;
+    mutable bool                    mAnimDecoded;
+    mutable bool                    mAnimHasFrames;
+    size_t                          mNumBones;
+    const HalfLifeModelBone*        mBones;
+    const HalfLifeModelBoneController*  mBoneControllers;
+    size_t                          mNumBoneControllers;
+    bool                            mPrecomputeRotations;
+    HalfLifeModelAnimLine*          mAnimLines;     // in the model arena
+    // packed frames either live in the model arena (decoded on load) or in mAnimBits (lazily decoded, can be released)
+    mutable const uint32_t*         mAnimWords;
+    mutable size_t                  mAnimWordsCount;
+    mutable MyArray<uint32_t>       mAnimBits;
+    // precomputed rotations, same as the packed frames
+    mutable const HalfLifeModelPackedQuat*      mAnimRotations;
+    mutable size_t                              mAnimRotationsCount;
+    mutable MyArray<HalfLifeModelPackedQuat>    mAnimRotationsData;
+    // bones grouped by how they are evaluated, rebuilt with every decode (and always heap allocated)
+    mutable StrongPtr<SkeletonProgram>          mSkeletonProgram;
+    mutable size_t                              mSkeletonProgramSize;
+    // numFrames x numBones, independent from the decoded frames
+    mutable MyArray<HalfLifeModelBakedBone>     mBakedPoses;
 };
\ No newline at end of file
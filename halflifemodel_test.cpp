@@ -0,0 +1,130 @@
+#include "halflifemodel.h"
+
+#include <cstdio>
+
+// HalfLifeModelInstance checks on a model built in memory, one bone and a single frame and a ten frames sequence
+// usage: halflifemodel-test
+
+enum : size_t {
+    kStaticSequence = 0,
+    kAnimatedSequence = 1,
+};
+
+constexpr uint32_t kAnimatedFrames = 10;
+
+template <typename T>
+static void PatchStruct(MemWriteStream& stream, const size_t offset, const T& s) {
+    memcpy(stream.Data() + offset, &s, sizeof(T));
+}
+
+static MemStream BuildTestModel(studiohdr_t& stdhdr) {
+    MemWriteStream stream;
+    stdhdr = {};
+    stdhdr.magic = scast<int>(MakeFourcc<'I','D','S','T'>());
+    stdhdr.version = 10;
+    strcpy(stdhdr.name, "test.mdl");
+    stream.WriteStruct(stdhdr);
+
+    mstudiobone_t bone = {};
+    strcpy(bone.name, "root");
+    bone.parent = -1;
+    for (size_t i = 0; i < 6; ++i) {
+        bone.bonecontroller[i] = -1;
+        bone.scale[i] = 1.0f;
+    }
+    stdhdr.numBones = 1;
+    stdhdr.offsetBones = scast<int>(stream.Length());
+    stream.WriteStruct(bone);
+
+    mstudioseqgroup_t seqGroup = {};
+    strcpy(seqGroup.label, "default");
+    stdhdr.numSeqGroups = 1;
+    stdhdr.offsetSeqGroups = scast<int>(stream.Length());
+    stream.WriteStruct(seqGroup);
+
+    const size_t seqDescOffset = stream.Length();
+    mstudioseqdesc_t seqDescs[2] = {};
+    strcpy(seqDescs[kStaticSequence].label, "idle");
+    seqDescs[kStaticSequence].numFrames = 1;
+    strcpy(seqDescs[kAnimatedSequence].label, "walk");
+    seqDescs[kAnimatedSequence].numFrames = kAnimatedFrames;
+    stdhdr.numSequences = 2;
+    stdhdr.offsetSequences = scast<int>(seqDescOffset);
+    stream.WriteStruct(seqDescs);
+
+    // all the channels are zero
+    for (mstudioseqdesc_t& seqDesc : seqDescs) {
+        seqDesc.fps = 30.0f;
+        seqDesc.numblends = 1;
+        seqDesc.offsetAnimData = scast<int>(stream.Length());
+        stream.WriteStruct(mstudioanim_t{});
+    }
+    PatchStruct(stream, seqDescOffset, seqDescs);
+
+    stdhdr.length = scast<int>(stream.Length());
+    PatchStruct(stream, 0, stdhdr);
+
+    void* data = malloc(stream.Length());
+    memcpy(data, stream.Data(), stream.Length());
+    return MemStream(data, stream.Length(), true);
+}
+
+
+static size_t sNumFailed = 0;
+
+static void Check(const bool ok, const char* what) {
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    sNumFailed += ok ? 0 : 1;
+}
+
+// plays the sequence like RenderView does, the frame advanced by the frame time and wrapped around the frames count
+static uint64_t PlayTicks(HalfLifeModelInstance& instance, const size_t sequenceIdx, float& frame, const size_t numTicks) {
+    const HalfLifeModelSequence* sequence = instance.GetModel()->GetSequence(sequenceIdx);
+    const float numFrames = scast<float>(sequence->GetFramesCount());
+    for (size_t tick = 0; tick < numTicks; ++tick) {
+        frame += (1.0f / 60.0f) * sequence->GetFPS();
+        if (frame >= numFrames) {
+            frame -= numFrames;
+        }
+        instance.CalculateSkeleton(frame, sequenceIdx);
+    }
+    return instance.GetPoseVersion();
+}
+
+int main() {
+    studiohdr_t stdhdr;
+    MemStream modelStream = BuildTestModel(stdhdr);
+
+    RefPtr<HalfLifeModel> model = MakeRefPtr<HalfLifeModel>();
+    if (!model->LoadFromMemStream(modelStream, stdhdr) || model->GetSequencesCount() != 2) {
+        fprintf(stderr, "halflifemodel-test: can't load the test model\n");
+        return 1;
+    }
+
+    {
+        HalfLifeModelInstance instance(model);
+        float frame = 0.0f;
+        instance.CalculateSkeleton(frame, kStaticSequence);
+        const uint64_t version = instance.GetPoseVersion();
+        Check(PlayTicks(instance, kStaticSequence, frame, 1000) == version, "single frame sequence keeps its pose version while playing");
+    }
+
+    {
+        HalfLifeModelInstance instance(model);
+        instance.CalculateSkeleton(3.25f, kAnimatedSequence);
+        const uint64_t version = instance.GetPoseVersion();
+        instance.CalculateSkeleton(3.25f + scast<float>(kAnimatedFrames), kAnimatedSequence);
+        Check(instance.GetPoseVersion() == version, "a frame one loop later is the same pose");
+        instance.CalculateSkeleton(3.25f + 0.1f / scast<float>(HalfLifeModelInstance::kPoseFrameSteps), kAnimatedSequence);
+        Check(instance.GetPoseVersion() == version, "a frame within the same blend step is the same pose");
+        instance.CalculateSkeleton(3.5f, kAnimatedSequence);
+        Check(instance.GetPoseVersion() != version, "another blend is a new pose");
+
+        float frame = 0.0f;
+        const uint64_t before = instance.GetPoseVersion();
+        Check(PlayTicks(instance, kAnimatedSequence, frame, 10) == before + 10, "playing an animated sequence makes a new pose every tick");
+    }
+
+    printf("%zu checks failed\n", sNumFailed);
+    return sNumFailed ? 1 : 0;
+}
@@ -9,9 +9,15 @@
 #include <QDragEnterEvent>
 #include <QDir>
 #include <QColorDialog>
+#include <QStandardPaths>
+#include <QStatusBar>
+#include <QProgressBar>
+#include <QElapsedTimer>
+#include <QInputDialog>
 
 #include "aboutdlg.h"
 #include "halflifemodel.h"
+#include "vfs.h"
 
 
 
@@ -39,8 +45,173 @@ static fs::path FixPath(const fs::path& pathToFix) {
 static const QString kLastOpenPath("LastOpenPath");
 static const QString kLastSavePath("LastSavePath");
 static const QString kRecentModelTemplate("RecentModel_");
+static const QString kModelsCacheBudget("ModelsCacheBudgetMB");
+static const QString kDiskCacheBudget("DiskCacheBudgetMB");
 
 constexpr size_t kMaxRecentModels = 6;
+constexpr size_t kDefaultModelsCacheBudgetMB = 512;
+constexpr size_t kDefaultDiskCacheBudgetMB = 256;
+
+// how long the UI thread may spend filling the sequences list at once
+constexpr qint64 kSequencesSliceMs = 8;
+
+
+// one of the files a model was loaded from, as it was right after the loading
+struct ModelSourceFile {
+    fs::path    path;
+    bool        present;
+    int64_t     mtime;
+
+    bool operator ==(const ModelSourceFile& other) const {
+        return path == other.path && present == other.present && mtime == other.mtime;
+    }
+};
+
+static MyArray<ModelSourceFile> StatModelSourceFiles(const HalfLifeModel& model) {
+    MyArray<ModelSourceFile> result;
+    for (const fs::path& path : model.GetSourceFiles()) {
+        VFSFileInfo info = {};
+        const bool present = VirtualFileSystem::GetFileInfo(path, info);
+        result.push_back({ path, present, present ? info.mtime : 0 });
+    }
+    return result;
+}
+
+
+// a single model opening, shared between the UI and the loading thread, and then the sequences preloading of the opened model
+struct ModelLoadRequest {
+    fs::path                    path;
+    CharString                  cacheKey;           // see ModelsCache::MakeKey
+    bool                        addToRecent = false;
+    bool                        fromMemory = false; // found in the models cache, no loading happened
+    std::atomic<bool>           cancelled{ false };
+    std::atomic<float>          progress{ 0.0f };
+    QElapsedTimer               timer;              // started when the model was requested, UI thread only
+    float                       loadedMs = 0.0f;
+    RefPtr<const HalfLifeModel> model;              // handed over to the UI thread when loaded
+    MyArray<ModelSourceFile>    sourceFiles;        // of the model, see ModelsCache::Find
+    RefPtr<RenderModelResources> resources;         // already uploaded textures of a cached model
+};
+
+struct ModelsCacheStats {
+    size_t  entries;
+    size_t  bytes;
+    size_t  budget;
+    size_t  hits;
+    size_t  misses;
+    size_t  evictions;
+};
+
+// recently opened models together with their GPU resources, LRU ordered, the most recent one is the last
+// models memory and textures count towards the budget, the shown model is never evicted
+class ModelsCache {
+public:
+    struct Entry {
+        CharString                      key;
+        RefPtr<const HalfLifeModel>     model;
+        RefPtr<RenderModelResources>    resources;
+        MyArray<ModelSourceFile>        sourceFiles;
+        size_t                          bytes;
+    };
+
+    ModelsCache(RenderView* renderView, const size_t budget)
+        : mRenderView(renderView)
+        , mBudget(budget)
+        , mTotalBytes(0)
+        , mHits(0)
+        , mMisses(0)
+        , mEvictions(0)
+    {
+    }
+
+    ~ModelsCache() {
+        for (Entry& entry : mEntries) {
+            mRenderView->ReleaseModelResources(entry.resources);
+        }
+    }
+
+    // a model changed on disk gets a new key, the stale entry just ages out, its textures and sequence groups files are
+    // only known after the loading, so Find checks those
+    // (archived models have no canonical path, so these fall back to the absolute one)
+    static CharString MakeKey(const fs::path& path) {
+        std::error_code ec;
+        fs::path fullPath = fs::canonical(path, ec);
+        if (ec) {
+            fullPath = fs::absolute(path, ec);
+        }
+        VFSFileInfo info = {};
+        VirtualFileSystem::GetFileInfo(path, info);
+        return fullPath.u8string() + "|" + std::to_string(info.mtime);
+    }
+
+    // the found entry becomes the most recently used one, an entry with any of its files changed since is dropped
+    const Entry* Find(const CharString& key) {
+        auto it = std::find_if(mEntries.begin(), mEntries.end(), [&key](const Entry& e) { return e.key == key; });
+        if (it != mEntries.end() && StatModelSourceFiles(*it->model) != it->sourceFiles) {
+            mTotalBytes -= it->bytes;
+            mRenderView->ReleaseModelResources(it->resources);
+            mEntries.erase(it);
+            ++mEvictions;
+            it = mEntries.end();
+        }
+        if (it == mEntries.end()) {
+            ++mMisses;
+            return nullptr;
+        }
+
+        ++mHits;
+        std::rotate(it, it + 1, mEntries.end());
+        return &mEntries.back();
+    }
+
+    void Put(const CharString& key, const RefPtr<const HalfLifeModel>& model, const RefPtr<RenderModelResources>& resources, const MyArray<ModelSourceFile>& sourceFiles) {
+        auto it = std::find_if(mEntries.begin(), mEntries.end(), [&key](const Entry& e) { return e.key == key; });
+        if (it != mEntries.end()) {
+            mEntries.erase(it);
+        }
+        mEntries.push_back({ key, model, resources, sourceFiles, 0 });
+
+        this->Trim();
+    }
+
+    ModelsCacheStats GetStats() const {
+        return { mEntries.size(), mTotalBytes, mBudget, mHits, mMisses, mEvictions };
+    }
+
+private:
+    void Trim() {
+        // lazily decoded animation makes models grow, so the sizes are taken anew every time
+        mTotalBytes = 0;
+        for (Entry& entry : mEntries) {
+            entry.bytes = entry.model->GetMemorySize() + (entry.resources ? entry.resources->gpuBytes : 0);
+            mTotalBytes += entry.bytes;
+        }
+
+        size_t numEvicted = 0;
+        while (mTotalBytes > mBudget && numEvicted + 1 < mEntries.size()) {
+            Entry& entry = mEntries[numEvicted];
+            mTotalBytes -= entry.bytes;
+            mRenderView->ReleaseModelResources(entry.resources);
+            ++numEvicted;
+        }
+
+        mEntries.erase(mEntries.begin(), mEntries.begin() + scast<ptrdiff_t>(numEvicted));
+        mEvictions += numEvicted;
+    }
+
+private:
+    RenderView*     mRenderView;
+    MyArray<Entry>  mEntries;
+    size_t          mBudget;
+    size_t          mTotalBytes;
+    size_t          mHits;
+    size_t          mMisses;
+    size_t          mEvictions;
+};
+
+static float ElapsedMs(const QElapsedTimer& timer) {
+    return scast<float>(timer.nsecsElapsed()) / 1000000.0f;
+}
 
 
 MainWindow::MainWindow(QWidget *parent)
@@ -48,6 +219,10 @@ MainWindow::MainWindow(QWidget *parent)
     , ui(new Ui::MainWindow)
     , mRenderView{}
     , mModel{}
+    , mModelInstance{}
+    , mLoadProgress(nullptr)
+    , mPublishedSequences(0)
+    , mDiskCacheBudget(0)
 {
     ui->setupUi(this);
 
@@ -58,35 +233,126 @@ MainWindow::MainWindow(QWidget *parent)
 
     this->setAcceptDrops(true);
 
+    mLoadProgress = new QProgressBar(this);
+    mLoadProgress->setRange(0, 100);
+    mLoadProgress->setMaximumWidth(200);
+    mLoadProgress->hide();
+    this->statusBar()->addPermanentWidget(mLoadProgress);
+
+    mLoadProgressTimer.setInterval(30);
+    connect(&mLoadProgressTimer, &QTimer::timeout, this, &MainWindow::UpdateLoadProgress);
+    mSequencesTimer.setInterval(0);
+    connect(&mSequencesTimer, &QTimer::timeout, this, &MainWindow::PublishSequences);
+    connect(mRenderView.get(), &RenderView::firstFrameRendered, this, &MainWindow::OnFirstFrameRendered);
+
+    QSettings registry;
+    const size_t cacheBudgetMB = scast<size_t>(registry.value(kModelsCacheBudget, qulonglong(kDefaultModelsCacheBudgetMB)).toULongLong());
+    mModelsCache = MakeStrongPtr<ModelsCache>(mRenderView.get(), cacheBudgetMB * 1024 * 1024);
+    mDiskCacheBudget = scast<size_t>(registry.value(kDiskCacheBudget, qulonglong(kDefaultDiskCacheBudgetMB)).toULongLong()) * 1024 * 1024;
+
     this->UpdateRecentModelsList();
 }
 
 MainWindow::~MainWindow() {
+    // loading threads post back to us, so they must be gone before we are
+    this->CancelModelLoading();
+    mLoadThreads.waitForDone();
+
+    // cached textures need the render view to be destroyed
+    mModelsCache.reset();
+
     delete ui;
 }
 
 void MainWindow::OpenModel(const fs::path& filePath, const bool addToRecent) {
-    fs::path fixedPath = FixPath(filePath);
+    // opening another model aborts the one still loading, the current one stays on screen meanwhile
+    this->CancelModelLoading();
+
+    RefPtr<ModelLoadRequest> request = MakeRefPtr<ModelLoadRequest>();
+    request->path = FixPath(filePath);
+    request->addToRecent = addToRecent;
+    request->cacheKey = ModelsCache::MakeKey(request->path);
+    request->timer.start();
+    mLoadRequest = request;
+
+    if (const ModelsCache::Entry* cached = mModelsCache->Find(request->cacheKey)) {
+        request->model = cached->model;
+        request->resources = cached->resources;
+        request->sourceFiles = cached->sourceFiles;
+        request->fromMemory = true;
+        this->OnModelLoaded(request);
+        return;
+    }
 
-    StrongPtr<HalfLifeModel> mdl = MakeStrongPtr<HalfLifeModel>();
-    if (mdl->LoadFromPath(fixedPath)) {
-        mRenderView->SetModel(nullptr);
-        mModel.swap(mdl);
-        mRenderView->SetModel(mModel.get());
+    // we only ever show one sequence at a time, so no need to decode them all upfront
+    HalfLifeModelLoadOptions loadOptions;
+    loadOptions.lazySequences = true;
+    // the skeleton is rebuilt every frame, so it's worth paying for the rotations once per sequence
+    loadOptions.precomputeRotations = true;
+    // the meshes are drawn every frame, so reorder them for the GPU vertex cache
+    loadOptions.optimizeVertexCache = true;
+    // reopening a model skips all the parsing if nothing changed since the last time, the least recently used files go above the budget
+    const QString cacheLocation = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (!cacheLocation.isEmpty() && mDiskCacheBudget > 0) {
+        loadOptions.cacheDir = fs::path(cacheLocation.toStdWString()) / "models";
+        loadOptions.cacheDirBudget = mDiskCacheBudget;
+    }
+    // only called during LoadFromPath, while the loading thread holds the request
+    ModelLoadRequest* requestPtr = request.get();
+    loadOptions.progressCallback = [requestPtr](const float progress)->bool {
+        requestPtr->progress = progress;
+        return !requestPtr->cancelled;
+    };
+
+    mLoadProgress->setValue(0);
+    mLoadProgress->show();
+    mLoadProgressTimer.start();
+
+    mLoadThreads.start([this, request, loadOptions]() {
+        StrongPtr<HalfLifeModel> mdl = MakeStrongPtr<HalfLifeModel>();
+        mdl->SetLoadOptions(loadOptions);
+        if (mdl->LoadFromPath(request->path)) {
+            // taken right away, so a file changed while the model goes to the UI thread is not trusted later
+            request->sourceFiles = StatModelSourceFiles(*mdl);
+            request->model = std::move(mdl);
+        }
 
-        QSettings registry;
-        QString lastOpenDir = registry.value(kLastOpenPath).toString();
+        QMetaObject::invokeMethod(this, [this, request]() {
+            this->OnModelLoaded(request);
+        }, Qt::QueuedConnection);
+    });
+}
 
-        fs::path folderPath = fs::absolute(fixedPath.parent_path());
-        lastOpenDir = QString::fromStdString(folderPath.u8string());
-        registry.setValue(kLastOpenPath, lastOpenDir);
 
-        this->UpdateUIForModel();
+// lets the user pick one of the models inside of the archive, which is then opened right from it
+void MainWindow::OpenArchive(const fs::path& archivePath) {
+    const RefPtr<const PakArchive> archive = VirtualFileSystem::MountArchive(FixPath(archivePath));
+    if (!archive) {
+        this->statusBar()->showMessage(tr("Failed to open %1").arg(QString::fromStdString(archivePath.u8string())));
+        return;
+    }
 
-        if (addToRecent) {
-            this->AddToRecentModelsList(QString::fromStdString(fixedPath.u8string()));
+    QStringList models;
+    for (size_t i = 0; i < archive->GetFilesCount(); ++i) {
+        const CharString& fileName = archive->GetFileName(i);
+        const QString name = QString::fromStdString(fileName);
+        if (name.endsWith(".mdl", Qt::CaseInsensitive) && !HalfLifeModel::IsCompanionFile(VirtualFileSystem::MakeArchiveFilePath(archive->GetPath(), fileName))) {
+            models.push_back(name);
         }
     }
+
+    if (models.isEmpty()) {
+        this->statusBar()->showMessage(tr("No models in %1").arg(QString::fromStdString(archivePath.u8string())));
+        return;
+    }
+
+    models.sort(Qt::CaseInsensitive);
+
+    bool ok = false;
+    const QString selected = QInputDialog::getItem(this, tr("Select model..."), tr("Models in %1:").arg(QString::fromStdString(archivePath.filename().u8string())), models, 0, false, &ok);
+    if (ok && !selected.isEmpty()) {
+        this->OpenModel(VirtualFileSystem::MakeArchiveFilePath(archive->GetPath(), selected.toStdString()), true);
+    }
 }
 
 
@@ -104,7 +370,7 @@ void MainWindow::dragEnterEvent(QDragEnterEvent* event) {
             const QUrl& url = urls[0];
             if (url.isLocalFile()) {
                 QString filePath = url.toLocalFile();
-                if (filePath.endsWith(".mdl")) {
+                if (filePath.endsWith(".mdl") || filePath.endsWith(".pak", Qt::CaseInsensitive)) {
                     event->acceptProposedAction();
                 }
             }
@@ -121,6 +387,10 @@ void MainWindow::dropEvent(QDropEvent* event) {
             this->OpenModel(filePath.toStdString(), true);
 
             event->acceptProposedAction();
+        } else if (filePath.endsWith(".pak", Qt::CaseInsensitive)) {
+            event->acceptProposedAction();
+
+            this->OpenArchive(filePath.toStdString());
         }
     }
 }
@@ -133,10 +403,14 @@ void MainWindow::on_actionLoad_model_triggered() {
     QSettings registry;
     QString lastOpenDir = registry.value(kLastOpenPath).toString();
 
-    QString path = QFileDialog::getOpenFileName(this, tr("Select Half-Life model..."), lastOpenDir, tr("Half-Life model (*.mdl)"));
+    QString path = QFileDialog::getOpenFileName(this, tr("Select Half-Life model..."), lastOpenDir, tr("Half-Life model (*.mdl);;Half-Life package (*.pak)"));
     if (!path.isEmpty()) {
         fs::path mdlPath = path.toStdString();
-        this->OpenModel(mdlPath, true);
+        if (VirtualFileSystem::IsArchive(mdlPath)) {
+            this->OpenArchive(mdlPath);
+        } else {
+            this->OpenModel(mdlPath, true);
+        }
     }
 }
 
@@ -215,7 +489,7 @@ void MainWindow::on_btnExportTexture_clicked() {
     QSettings registry;
     QString lastSaveDir = registry.value(kLastSavePath).toString();
 
-    QString proposedName = QDir(lastSaveDir).filePath(QString::fromStdString(hltexture.name));
+    QString proposedName = QDir(lastSaveDir).filePath(QString::fromUtf8(hltexture.name.data(), scast<int>(hltexture.name.size())));
 
     QString path = QFileDialog::getSaveFileName(this, tr("Where to save texture..."), proposedName, tr("BMP image (*.bmp)"));
     if (!path.isEmpty()) {
@@ -283,7 +557,7 @@ void MainWindow::UpdateUIForModel() {
         ui->lstSkins->clear();
         for (size_t i = 0; i < mModel->GetBodyPartsCount(); ++i) {
             const HalfLifeModelBodypart* bodyPart = mModel->GetBodyPart(i);
-            ui->lstBodyParts->addItem(QString::fromStdString(bodyPart->GetName()));
+            ui->lstBodyParts->addItem(QString::fromUtf8(bodyPart->GetName().data(), scast<int>(bodyPart->GetName().size())));
         }
         ui->lstBodyParts->setCurrentRow(0);
         for (size_t i = 0; i < mModel->GetSkinsCount(); ++i) {
@@ -300,7 +574,7 @@ void MainWindow::UpdateUIForModel() {
             HLTextureToQImage(hltexture, img);
 
             QListWidgetItem* item = new QListWidgetItem();
-            item->setText(QString::fromStdString(hltexture.name));
+            item->setText(QString::fromUtf8(hltexture.name.data(), scast<int>(hltexture.name.size())));
             item->setToolTip(item->text());
             item->setIcon(QIcon(QPixmap::fromImage(img)));
             item->setData(Qt::UserRole, scast<int>(i));
@@ -308,12 +582,152 @@ void MainWindow::UpdateUIForModel() {
         }
         ui->spinImageZoom->setValue(1.0);
 
-        // sequences tab
+        // sequences tab, filled by PublishSequences
         ui->lstSequences->clear();
-        const size_t numSequences = mModel->GetSequencesCount();
-        for (size_t i = 0; i < numSequences; ++i) {
-            ui->lstSequences->addItem(QString::fromStdString(mModel->GetSequence(i)->GetName()));
+        mPublishedSequences = 0;
+        mSequencesTimer.start();
+    }
+}
+
+void MainWindow::CancelModelLoading() {
+    if (mLoadRequest) {
+        mLoadRequest->cancelled = true;
+        mLoadRequest.reset();
+    }
+    if (mPreloadRequest) {
+        mPreloadRequest->cancelled = true;
+        mPreloadRequest.reset();
+    }
+
+    mLoadProgressTimer.stop();
+    mLoadProgress->hide();
+}
+
+void MainWindow::OnModelLoaded(const RefPtr<ModelLoadRequest>& request) {
+    // superseded by another model opening
+    if (request != mLoadRequest) {
+        return;
+    }
+
+    mLoadProgressTimer.stop();
+    mLoadProgress->hide();
+
+    if (!request->model) {
+        mLoadRequest.reset();
+        this->statusBar()->showMessage(tr("Failed to open %1").arg(QString::fromStdString(request->path.u8string())));
+        return;
+    }
+
+    request->loadedMs = ElapsedMs(request->timer);
+
+    // textures are uploaded once per model for as long as it stays in the cache
+    RefPtr<RenderModelResources> resources = std::move(request->resources);
+    if (!resources) {
+        resources = mRenderView->CreateModelResources(request->model.get());
+    }
+
+    mRenderView->SetModel(nullptr, nullptr);
+    mModelInstance.reset();
+    mModel = std::move(request->model);
+    mModelInstance = MakeStrongPtr<HalfLifeModelInstance>(mModel);
+    mRenderView->SetModel(mModelInstance.get(), resources);
+
+    mModelsCache->Put(request->cacheKey, mModel, resources, request->sourceFiles);
+
+    QSettings registry;
+    QString lastOpenDir = registry.value(kLastOpenPath).toString();
+
+    // archived models are in the archive folder as far as the file dialog is concerned
+    std::error_code ec;
+    fs::path folderPath = fs::absolute(request->path.parent_path(), ec);
+    while (folderPath.has_relative_path() && !fs::is_directory(folderPath, ec)) {
+        folderPath = folderPath.parent_path();
+    }
+    lastOpenDir = QString::fromStdString(folderPath.u8string());
+    registry.setValue(kLastOpenPath, lastOpenDir);
+
+    this->UpdateUIForModel();
+    this->StartSequencesPreload(request);
+
+    if (request->addToRecent) {
+        this->AddToRecentModelsList(QString::fromStdString(request->path.u8string()));
+    }
+}
+
+// time to first frame is measured from the moment the model was requested
+void MainWindow::OnFirstFrameRendered() {
+    if (mLoadRequest && mModel) {
+        const HalfLifeModelLoadStats& stats = mModel->GetLoadStats();
+        QString message;
+        if (mLoadRequest->fromMemory) {
+            message = tr("Reopened from memory, first frame in %1 ms").arg(QString::number(ElapsedMs(mLoadRequest->timer), 'f', 1));
+        } else {
+            const QString source = stats.fromCache ? tr("cache") : tr("file");
+            message = tr("Loaded from %1 in %2 ms (parsing %3 ms), first frame in %4 ms")
+                      .arg(source)
+                      .arg(QString::number(mLoadRequest->loadedMs, 'f', 1))
+                      .arg(QString::number(stats.totalMs, 'f', 1))
+                      .arg(QString::number(ElapsedMs(mLoadRequest->timer), 'f', 1));
+            message += tr(" | vertex cache ACMR %1 -> %2")
+                       .arg(QString::number(stats.acmrBefore, 'f', 2))
+                       .arg(QString::number(stats.acmrAfter, 'f', 2));
+        }
+
+        const ModelsCacheStats cacheStats = mModelsCache->GetStats();
+        message += tr(" | models cache: %1 models, %2 of %3 MB, %4 hits, %5 misses, %6 evicted")
+                   .arg(cacheStats.entries)
+                   .arg(QString::number(scast<double>(cacheStats.bytes) / (1024.0 * 1024.0), 'f', 1))
+                   .arg(cacheStats.budget / (1024 * 1024))
+                   .arg(cacheStats.hits)
+                   .arg(cacheStats.misses)
+                   .arg(cacheStats.evictions);
+
+        this->statusBar()->showMessage(message);
+        mLoadRequest.reset();
+    }
+}
+
+void MainWindow::UpdateLoadProgress() {
+    if (mLoadRequest) {
+        mLoadProgress->setValue(scast<int>(mLoadRequest->progress * 100.0f));
+    }
+}
+
+// decodes the sequences animation ahead on a loading thread, in the list order and while there's budget for it (lazy mode only)
+// the UI thread never waits for it, sequences picked before they are preloaded are decoded on first use as usual
+void MainWindow::StartSequencesPreload(const RefPtr<ModelLoadRequest>& request) {
+    mPreloadRequest = request;
+
+    const RefPtr<const HalfLifeModel> model = mModel;
+    mLoadThreads.start([request, model]() {
+        const size_t budget = model->GetLoadOptions().decodedAnimBudget;
+        for (size_t i = 0; i < model->GetSequencesCount() && !request->cancelled; ++i) {
+            if (budget && model->GetDecodedAnimSize() >= budget) {
+                break;
+            }
+            model->PreloadSequenceAnim(i);
         }
+    });
+}
+
+// adds sequences names to the list a few at a time, so that huge lists don't block the UI
+void MainWindow::PublishSequences() {
+    const size_t numSequences = mModel ? mModel->GetSequencesCount() : 0;
+    if (mPublishedSequences >= numSequences) {
+        mSequencesTimer.stop();
+        return;
+    }
+
+    QElapsedTimer sliceTimer;
+    sliceTimer.start();
+
+    do {
+        const StringView& name = mModel->GetSequence(mPublishedSequences)->GetName();
+        ui->lstSequences->addItem(QString::fromUtf8(name.data(), scast<int>(name.size())));
+        ++mPublishedSequences;
+    } while (mPublishedSequences < numSequences && sliceTimer.elapsed() < kSequencesSliceMs);
+
+    if (ui->lstSequences->currentRow() < 0) {
         ui->lstSequences->setCurrentRow(0);
     }
 }
@@ -483,7 +897,7 @@ void MainWindow::on_lstSequences_currentRowChanged(int currentRow) {
 
         const HalfLifeModelSequence* sequence = mModel->GetSequence(scast<size_t>(currentRow));
 
-        ui->lblSequenceName->setText(QString::fromStdString(sequence->GetName()));
+        ui->lblSequenceName->setText(QString::fromUtf8(sequence->GetName().data(), scast<int>(sequence->GetName().size())));
         ui->lblSequenceFPS->setText(QString("%1 %2").arg(sequence->GetFPS()).arg(tr("FPS")));
         ui->lblSequenceFrames->setText(QString("%1 %2").arg(sequence->GetFramesCount()).arg(tr("frames")));
         ui->lblSequenceEvents->setText(QString("%1 %2").arg(sequence->GetEventsCount()).arg(tr("events")));
@@ -509,7 +923,7 @@ void MainWindow::on_lstEvents_currentRowChanged(int currentRow) {
                 ui->lblEventFrame->setText(QString("%1 %2").arg(tr("Frame")).arg(event.frame));
                 ui->lblEventEvent->setText(QString("%1 %2").arg(tr("Event")).arg(event.event));
                 ui->lblEventType->setText(QString("%1 %2").arg(tr("Type")).arg(event.type));
-                ui->lblEventOptions->setText(event.options.empty() ? tr("No options") : QString::fromStdString(event.options));
+                ui->lblEventOptions->setText(event.options.empty() ? tr("No options") : QString::fromUtf8(event.options.data(), scast<int>(event.options.size())));
                 ui->lblEventOptions->setToolTip(ui->lblEventOptions->text());
             }
         }
@@ -534,7 +948,7 @@ void MainWindow::on_comboBoneControllers_currentIndexChanged(int index) {
 
         if (controller.boneIdx >= 0 && controller.boneIdx < mModel->GetBonesCount()) {
             const HalfLifeModelBone& bone = mModel->GetBone(scast<size_t>(controller.boneIdx));
-            ui->lblBoneControllerBoneName->setText(QString::fromStdString(bone.name));
+            ui->lblBoneControllerBoneName->setText(QString::fromUtf8(bone.name.data(), scast<int>(bone.name.size())));
         }
     }
 }
@@ -544,7 +958,7 @@ void MainWindow::on_sliderBoneControllerValue_valueChanged(int value) {
         const int index = ui->comboBoneControllers->currentIndex();
 
         if (index >= 0 && index < mModel->GetBoneControllersCount()) {
-            mModel->SetBoneControllerValue(scast<size_t>(index), scast<float>(value));
+            mModelInstance->SetBoneControllerValue(scast<size_t>(index), scast<float>(value));
         }
     }
 }
@@ -556,7 +970,7 @@ void MainWindow::on_lstBodyParts_currentRowChanged(int currentRow) {
         const HalfLifeModelBodypart* bodyPart = mModel->GetBodyPart(scast<size_t>(currentRow));
         for (size_t i = 0; i < bodyPart->GetStudioModelsCount(); ++i) {
             const HalfLifeModelStudioModel* smdl = bodyPart->GetStudioModel(i);
-            ui->lstBodySubModels->addItem(QString::fromStdString(smdl->GetName()));
+            ui->lstBodySubModels->addItem(QString::fromUtf8(smdl->GetName().data(), scast<int>(smdl->GetName().size())));
         }
     }
 }
@@ -569,7 +983,7 @@ void MainWindow::on_lstBodySubModels_currentRowChanged(int currentRow) {
             const HalfLifeModelBodypart* bodyPart = mModel->GetBodyPart(scast<size_t>(bodyPartIdx));
 
             if (currentRow >= 0 && currentRow < bodyPart->GetStudioModelsCount()) {
-                mModel->SetBodyPartActiveSubModel(bodyPartIdx, scast<size_t>(currentRow));
+                mModelInstance->SetBodyPartActiveSubModel(bodyPartIdx, scast<size_t>(currentRow));
             }
         }
     }
@@ -578,6 +992,6 @@ void MainWindow::on_lstBodySubModels_currentRowChanged(int currentRow) {
 
 void MainWindow::on_lstSkins_currentRowChanged(int currentRow) {
     if (mModel && currentRow >= 0 && currentRow < mModel->GetSkinsCount()) {
-        mModel->SetActiveSkin(scast<size_t>(currentRow));
+        mModelInstance->SetActiveSkin(scast<size_t>(currentRow));
     }
 }
@@ -3,14 +3,20 @@
 
 #include <QMainWindow>
 #include <QListWidgetItem>
+#include <QThreadPool>
+#include <QTimer>
 #include "mycommon.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
 QT_END_NAMESPACE
 
+class QProgressBar;
 class RenderView;
 class HalfLifeModel;
+class HalfLifeModelInstance;
+struct ModelLoadRequest;
+class ModelsCache;
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -20,6 +26,7 @@ public:
     ~MainWindow();
 
     void                        OpenModel(const fs::path& filePath, const bool addToRecent);
+    void                        OpenArchive(const fs::path& archivePath);
 
 protected:
     void                        showEvent(QShowEvent* ev) override;
@@ -63,9 +70,32 @@ private:
     void                        AddToRecentModelsList(const QString& entry);
     void                        UpdateRecentModelsList();
 
+    void                        CancelModelLoading();
+    void                        OnModelLoaded(const RefPtr<ModelLoadRequest>& request);
+    void                        OnFirstFrameRendered();
+    void                        UpdateLoadProgress();
+    void                        StartSequencesPreload(const RefPtr<ModelLoadRequest>& request);
+    void                        PublishSequences();
+
 private:
     Ui::MainWindow*             ui;
     StrongPtr<RenderView>       mRenderView;
-    StrongPtr<HalfLifeModel>    mModel;
+    RefPtr<const HalfLifeModel> mModel;
+    // what's shown, submodels, skin and controllers selection goes here
+    StrongPtr<HalfLifeModelInstance>    mModelInstance;
+    // models are loaded in the background, the latest request is the only one that matters
+    QThreadPool                 mLoadThreads;
+    RefPtr<ModelLoadRequest>    mLoadRequest;
+    // the request of the shown model, cancelling it stops the sequences preloading
+    RefPtr<ModelLoadRequest>    mPreloadRequest;
+    QProgressBar*               mLoadProgress;
+    QTimer                      mLoadProgressTimer;
+    // sequences list is filled gradually after the model is shown
+    QTimer                      mSequencesTimer;
+    size_t                      mPublishedSequences;
+    // recently opened models, reopening one of them skips loading and textures upload
+    StrongPtr<ModelsCache>      mModelsCache;
+    // post-processed models on disk, 0 - not used at all
+    size_t                      mDiskCacheBudget;
 };
 #endif // MAINWINDOW_H
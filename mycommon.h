@@ -10,8 +10,14 @@
 #include <algorithm>
 #include <functional>
 #include <cassert>
+#include <cstring>
 #include <cuchar>
 #include <random>
+#include <thread>
+#include <future>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
 
 #define rcast reinterpret_cast
 #define scast static_cast
@@ -67,10 +73,40 @@ constexpr RefPtr<T> SCastRefPtr(const RefPtr<U>& p) noexcept {
 #endif
 
 
+// non-owning view of a contiguous array, the memory must outlive the view
+template <typename T>
+class ArrayView {
+public:
+    ArrayView()
+        : ptr(nullptr)
+        , count(0) {
+    }
+    ArrayView(const T* _ptr, const size_t _count)
+        : ptr(_ptr)
+        , count(_count) {
+    }
+
+    inline const T& operator[](const size_t idx) const {
+        DebugAssert(idx < this->count);
+        return this->ptr[idx];
+    }
+
+    inline const T* data() const { return this->ptr; }
+    inline size_t size() const { return this->count; }
+    inline bool empty() const { return this->count == 0; }
+    inline const T* begin() const { return this->ptr; }
+    inline const T* end() const { return this->ptr + this->count; }
+
+private:
+    const T*    ptr;
+    size_t      count;
+};
+
+
 class MemStream {
+public:
     using OwnedPtrType = std::shared_ptr<uint8_t>;
 
-public:
     MemStream()
         : data(nullptr)
         , length(0)
@@ -87,6 +123,13 @@ public:
             ownedPtr = OwnedPtrType(const_cast<uint8_t*>(data), free);
         }
     }
+    // shares ownership with `_owner`, use it to keep memory that needs custom release (mapped files) alive
+    MemStream(const void* _data, const size_t _size, const OwnedPtrType& _owner)
+        : data(rcast<const uint8_t*>(_data))
+        , length(_size)
+        , cursor(0)
+        , ownedPtr(_owner) {
+    }
     MemStream(const MemStream& other)
         : data(other.data)
         , length(other.length)
@@ -208,6 +251,15 @@ public:
         return this->data + this->cursor;
     }
 
+    // returns an empty view if requested range doesn't fit into the stream
+    template <typename T>
+    ArrayView<T> GetView(const size_t offset, const size_t count) const {
+        if (offset > this->length || count > (this->length - offset) / sizeof(T)) {
+            return {};
+        }
+        return ArrayView<T>(rcast<const T*>(this->data + offset), count);
+    }
+
     MemStream Substream(const size_t subStreamLength) const {
         const size_t allowedLength = ((this->cursor + subStreamLength) > this->Length()) ? (this->Length() - this->cursor) : subStreamLength;
         return MemStream(this->GetDataAtCursor(), allowedLength);
@@ -219,6 +271,13 @@ public:
         return MemStream(this->data + allowedOffset, allowedLength);
     }
 
+    // unlike Substream keeps the memory owner alive, so the result can outlive this stream
+    MemStream SharedSubstream(const size_t subStreamOffset, const size_t subStreamLength) const {
+        MemStream result = this->Substream(subStreamOffset, subStreamLength);
+        result.ownedPtr = this->ownedPtr;
+        return result;
+    }
+
     MemStream Clone() const {
         if (this->ownedPtr) {
             return *this;
@@ -237,6 +296,69 @@ private:
     OwnedPtrType    ownedPtr;
 };
 
+// growing in-memory buffer, the writing counterpart of MemStream
+class MemWriteStream {
+public:
+    MemWriteStream() {
+    }
+    ~MemWriteStream() {
+    }
+
+    inline size_t Length() const {
+        return this->buffer.size();
+    }
+
+    inline const uint8_t* Data() const {
+        return this->buffer.data();
+    }
+
+    inline uint8_t* Data() {
+        return this->buffer.data();
+    }
+
+    void Write(const void* data, const size_t bytesToWrite) {
+        if (bytesToWrite > 0) {
+            const uint8_t* bytes = rcast<const uint8_t*>(data);
+            this->buffer.insert(this->buffer.end(), bytes, bytes + bytesToWrite);
+        }
+    }
+
+    template <typename T>
+    void WriteStruct(const T& s) {
+        this->Write(&s, sizeof(T));
+    }
+
+    // pads with zeroes so that the next write starts at a multiple of `alignment`
+    void Align(const size_t alignment) {
+        const size_t remainder = this->buffer.size() % alignment;
+        if (remainder) {
+            this->buffer.resize(this->buffer.size() + (alignment - remainder), 0);
+        }
+    }
+
+#define _IMPL_WRITE_FOR_TYPE(type, name)        \
+    inline void Write##name(const type value) { \
+        this->WriteStruct<type>(value);         \
+    }
+
+    _IMPL_WRITE_FOR_TYPE(int8_t, I8);
+    _IMPL_WRITE_FOR_TYPE(uint8_t, U8);
+    _IMPL_WRITE_FOR_TYPE(int16_t, I16);
+    _IMPL_WRITE_FOR_TYPE(uint16_t, U16);
+    _IMPL_WRITE_FOR_TYPE(int32_t, I32);
+    _IMPL_WRITE_FOR_TYPE(uint32_t, U32);
+    _IMPL_WRITE_FOR_TYPE(int64_t, I64);
+    _IMPL_WRITE_FOR_TYPE(uint64_t, U64);
+    _IMPL_WRITE_FOR_TYPE(bool, Bool);
+    _IMPL_WRITE_FOR_TYPE(float, F32);
+    _IMPL_WRITE_FOR_TYPE(double, F64);
+
+#undef _IMPL_WRITE_FOR_TYPE
+
+private:
+    BytesArray  buffer;
+};
+
 template <char a, char b, char c, char d>
 constexpr uint32_t MakeFourcc() {
     const uint32_t result = scast<uint32_t>(a) | (scast<uint32_t>(b) << 8) | (scast<uint32_t>(c) << 16) | (scast<uint32_t>(d) << 24);
@@ -247,3 +369,237 @@ template <typename T>
 constexpr bool IsPowerOfTwo(const T& x) {
     return (x != 0) && ((x & (x - 1)) == 0);
 }
+
+
+// bump allocator for data that lives and dies together, there's no freeing of single allocations,
+// everything goes away at once with Reset() or the arena itself
+// allocations are thread-safe, so parallel loading jobs can share one arena
+class MemArena {
+public:
+    static constexpr size_t kMinBlockSize = 64 * 1024;
+    static constexpr size_t kMaxBlockSize = 16 * 1024 * 1024;
+
+    MemArena()
+        : nextBlockSize(kMinBlockSize)
+        , usedSize(0)
+        , reservedSize(0) {
+    }
+    ~MemArena() {
+        this->Reset();
+    }
+
+    MemArena(const MemArena&) = delete;
+    MemArena& operator=(const MemArena&) = delete;
+
+    // pointers into the arena stay valid, blocks just change the owner
+    MemArena(MemArena&& other) noexcept
+        : MemArena() {
+        *this = std::move(other);
+    }
+    MemArena& operator=(MemArena&& other) noexcept {
+        if (this != &other) {
+            this->Reset();
+            this->blocks.swap(other.blocks);
+            this->destructors.swap(other.destructors);
+            std::swap(this->nextBlockSize, other.nextBlockSize);
+            std::swap(this->usedSize, other.usedSize);
+            std::swap(this->reservedSize, other.reservedSize);
+        }
+        return *this;
+    }
+
+    // runs destructors of the objects created with New() in reverse order and releases all the memory
+    void Reset() {
+        std::lock_guard<std::mutex> guard(this->lock);
+        for (auto it = this->destructors.rbegin(); it != this->destructors.rend(); ++it) {
+            it->destroy(it->object);
+        }
+        this->destructors.clear();
+        for (Block& block : this->blocks) {
+            free(block.data);
+        }
+        this->blocks.clear();
+        this->nextBlockSize = kMinBlockSize;
+        this->usedSize = 0;
+        this->reservedSize = 0;
+    }
+
+    void* Alloc(const size_t size, const size_t alignment) {
+        DebugAssert(IsPowerOfTwo(alignment));
+
+        std::lock_guard<std::mutex> guard(this->lock);
+        void* result = this->blocks.empty() ? nullptr : this->TryAllocFromBlock(this->blocks.back(), size, alignment);
+        if (!result) {
+            // big allocations get their own block, so the current one is not wasted
+            const size_t fullSize = size + alignment;
+            if (fullSize > this->nextBlockSize / 4) {
+                Block block = this->NewBlock(fullSize);
+                result = this->TryAllocFromBlock(block, size, alignment);
+                this->blocks.insert(this->blocks.empty() ? this->blocks.end() : this->blocks.end() - 1, block);
+            } else {
+                this->blocks.push_back(this->NewBlock(this->nextBlockSize));
+                this->nextBlockSize = std::min(this->nextBlockSize * 2, kMaxBlockSize);
+                result = this->TryAllocFromBlock(this->blocks.back(), size, alignment);
+            }
+        }
+        return result;
+    }
+
+    // value-initialized (zero-filled for plain data types) and never destructed, so only for types that need no destruction
+    template <typename T>
+    T* AllocArray(const size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena arrays are never destructed");
+        if (!count) {
+            return nullptr;
+        }
+        T* result = scast<T*>(this->Alloc(count * sizeof(T), alignof(T)));
+        std::uninitialized_value_construct_n(result, count);
+        return result;
+    }
+
+    template <typename T>
+    ArrayView<T> CopyArray(const T* data, const size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena arrays are never destructed");
+        if (!count) {
+            return {};
+        }
+        T* result = scast<T*>(this->Alloc(count * sizeof(T), alignof(T)));
+        std::uninitialized_copy_n(data, count, result);
+        return ArrayView<T>(result, count);
+    }
+
+    // the copy is zero-terminated, so data() can be used as a C string
+    StringView CopyString(const StringView& str) {
+        char* result = this->AllocArray<char>(str.length() + 1);
+        std::memcpy(result, str.data(), str.length());
+        return StringView(result, str.length());
+    }
+
+    // fixed size char arrays of the file formats, not always zero-terminated
+    StringView CopyString(const char* str, const size_t maxLength) {
+        return this->CopyString(StringView(str, strnlen(str, maxLength)));
+    }
+
+    template <typename T, typename... Args>
+    T* New(Args&&... args) {
+        T* result = new (this->Alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        if (!std::is_trivially_destructible<T>::value) {
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->destructors.push_back({ [](void* object) { scast<T*>(object)->~T(); }, result });
+        }
+        return result;
+    }
+
+    // bytes handed out and bytes actually taken from the system
+    size_t GetUsedSize() const {
+        return this->usedSize;
+    }
+    size_t GetReservedSize() const {
+        return this->reservedSize;
+    }
+
+private:
+    struct Block {
+        uint8_t*    data;
+        size_t      size;
+        size_t      used;
+    };
+
+    struct Destructor {
+        void      (*destroy)(void*);
+        void*       object;
+    };
+
+    Block NewBlock(const size_t size) {
+        Block block = { scast<uint8_t*>(malloc(size)), size, 0 };
+        if (!block.data) {
+            throw std::bad_alloc();
+        }
+        this->reservedSize += size;
+        return block;
+    }
+
+    void* TryAllocFromBlock(Block& block, const size_t size, const size_t alignment) {
+        const uintptr_t base = rcast<uintptr_t>(block.data);
+        const uintptr_t start = (base + block.used + alignment - 1) & ~(scast<uintptr_t>(alignment) - 1);
+        if (start + size > base + block.size) {
+            return nullptr;
+        }
+        block.used = scast<size_t>(start + size - base);
+        this->usedSize += size;
+        return rcast<void*>(start);
+    }
+
+private:
+    std::mutex          lock;
+    MyArray<Block>      blocks;         // the last one is the current one
+    MyArray<Destructor> destructors;
+    size_t              nextBlockSize;
+    size_t              usedSize;
+    size_t              reservedSize;
+};
+
+
+// fast non-cryptographic 64-bit hash, good enough to detect changed or corrupted data
+inline uint64_t HashBytes(const void* data, const size_t length, uint64_t seed = 0) {
+    constexpr uint64_t kMul0 = 0x9E3779B97F4A7C15ull;
+    constexpr uint64_t kMul1 = 0xC2B2AE3D27D4EB4Full;
+
+    const uint8_t* bytes = rcast<const uint8_t*>(data);
+    uint64_t h = seed ^ (scast<uint64_t>(length) * kMul0);
+
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+        uint64_t w;
+        std::memcpy(&w, bytes + i, sizeof(w));
+        h ^= w * kMul1;
+        h = ((h << 31) | (h >> 33)) * kMul0;
+    }
+
+    uint64_t tail = 0;
+    for (size_t shift = 0; i < length; ++i, shift += 8) {
+        tail |= scast<uint64_t>(bytes[i]) << shift;
+    }
+    h ^= tail * kMul1;
+
+    h ^= h >> 33;
+    h *= kMul1;
+    h ^= h >> 29;
+    return h;
+}
+
+// number of threads ParallelFor will actually run on (including the calling one)
+inline size_t ParallelForThreadsCount(const size_t count, const size_t numThreads) {
+    const size_t hwThreads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min(count, numThreads ? numThreads : hwThreads));
+}
+
+// calls func(idx) for every idx in [0, count) spread over numThreads threads (0 - all hardware threads)
+// the calling thread takes part in the work, indices are handed out dynamically so uneven jobs balance out
+template <typename TFunc>
+void ParallelFor(const size_t count, const size_t numThreads, const TFunc& func) {
+    const size_t threadsToUse = ParallelForThreadsCount(count, numThreads);
+    if (threadsToUse <= 1) {
+        for (size_t i = 0; i < count; ++i) {
+            func(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> nextIdx{ 0 };
+    auto worker = [&nextIdx, count, &func]() {
+        for (size_t i = nextIdx.fetch_add(1); i < count; i = nextIdx.fetch_add(1)) {
+            func(i);
+        }
+    };
+
+    MyArray<std::thread> threads;
+    threads.reserve(threadsToUse - 1);
+    for (size_t i = 1; i < threadsToUse; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& t : threads) {
+        t.join();
+    }
+}
@@ -1,13 +1,24 @@
 ﻿#pragma once
 #include <cmath>
 #include <cassert>
+#include <cfloat>
 
 #ifndef DebugAssert
 #define DebugAssert assert
 #endif
 
-//#define MYMATH_ALIGN_FOR_SSE    alignas(16)
+// SSE backend for vec4f, quatf and mat4f, picked at compile time, define MYMATH_NO_SIMD to force the scalar code
+// every SIMD path does the same operations in the same order as the scalar one, so the results are bit-identical
+#if !defined(MYMATH_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define MYMATH_USE_SSE
+#include <emmintrin.h>
+#endif
+
+#ifdef MYMATH_USE_SSE
+#define MYMATH_ALIGN_FOR_SSE    alignas(16)
+#else
 #define MYMATH_ALIGN_FOR_SSE
+#endif
 
 constexpr float MM_Pi               = 3.14159265358979323846f;
 constexpr float MM_InvPi            = 1.0f / MM_Pi;
@@ -64,25 +75,25 @@ inline T Clamp(const T& x, const T& left, const T& right) {
 }
 
 inline float FAbs(const float x) {
-    return std::fabsf(x);
+    return std::fabs(x);
 }
 inline float Sin(const float x) {
-    return std::sinf(x);
+    return std::sin(x);
 }
 inline float ASin(const float x) {
-    return std::asinf(x);
+    return std::asin(x);
 }
 inline float Cos(const float x) {
-    return std::cosf(x);
+    return std::cos(x);
 }
 inline float ACos(const float x) {
-    return std::acosf(x);
+    return std::acos(x);
 }
 inline float Sqrt(const float x) {
-    return std::sqrtf(x);
+    return std::sqrt(x);
 }
 inline int Floori(const float x) {
-    return static_cast<int>(std::floorf(x));
+    return static_cast<int>(std::floor(x));
 }
 
 
@@ -260,6 +271,11 @@ struct MYMATH_ALIGN_FOR_SSE vec4f {
     vec4f() : x(0.0f), y(0.0f), z(0.0f), w(0.0f) {}
     vec4f(const float _x, const float _y, const float _z, const float _w) : x(_x), y(_y), z(_z), w(_w) {}
     vec4f(const vec4f& other) : x(other.x), y(other.y), z(other.z), w(other.w) {}
+#ifdef MYMATH_USE_SSE
+    explicit vec4f(const __m128 v) { _mm_store_ps(&x, v); }
+
+    inline __m128 simd() const { return _mm_load_ps(&x); }
+#endif
 
     inline float operator[](const size_t index) const {
         DebugAssert(index == 0 || index == 1 || index == 2 || index == 3);
@@ -277,6 +293,22 @@ struct MYMATH_ALIGN_FOR_SSE vec4f {
         return x != other.x || y != other.y || z != other.z || w != other.w;
     }
 
+#ifdef MYMATH_USE_SSE
+    inline vec4f operator-() const { return vec4f(_mm_xor_ps(this->simd(), _mm_set1_ps(-0.0f))); }
+    inline vec4f operator*(const float f) const { return vec4f(_mm_mul_ps(this->simd(), _mm_set1_ps(f))); }
+    inline vec4f operator/(const float f) const { return vec4f(_mm_div_ps(this->simd(), _mm_set1_ps(f))); }
+    inline vec4f operator+(const vec4f& other) const { return vec4f(_mm_add_ps(this->simd(), other.simd())); }
+    inline vec4f operator-(const vec4f& other) const { return vec4f(_mm_sub_ps(this->simd(), other.simd())); }
+    inline vec4f operator*(const vec4f& other) const { return vec4f(_mm_mul_ps(this->simd(), other.simd())); }
+    inline vec4f operator/(const vec4f& other) const { return vec4f(_mm_div_ps(this->simd(), other.simd())); }
+
+    inline vec4f& operator+=(const vec4f& other) { return *this = *this + other; }
+    inline vec4f& operator-=(const vec4f& other) { return *this = *this - other; }
+    inline vec4f& operator*=(const vec4f& other) { return *this = *this * other; }
+    inline vec4f& operator/=(const vec4f& other) { return *this = *this / other; }
+    inline vec4f& operator*=(const float f) { return *this = *this * f; }
+    inline vec4f& operator/=(const float f) { return *this = *this / f; }
+#else
     inline vec4f operator-() const { return vec4f(-x, -y, -z, -w); }
     inline vec4f operator*(const float f) const { return vec4f(x * f, y * f, z * f, w * f); }
     inline vec4f operator/(const float f) const { return vec4f(x / f, y / f, z / f, w / f); }
@@ -327,9 +359,10 @@ struct MYMATH_ALIGN_FOR_SSE vec4f {
         w /= f;
         return *this;
     }
+#endif
 
     friend inline vec4f operator*(const float f, const vec4f& v) {
-        return vec4f(f * v.x, f * v.y, f * v.z, f * v.w);
+        return v * f;
     }
 
     inline float length() const {
@@ -350,6 +383,11 @@ struct MYMATH_ALIGN_FOR_SSE quatf {
     quatf() : x(0.0f), y(0.0f), z(0.0f), w(0.0f) {}
     quatf(const float _x, const float _y, const float _z, const float _w) : x(_x), y(_y), z(_z), w(_w) {}
     quatf(const quatf& other) : x(other.x), y(other.y), z(other.z), w(other.w) {}
+#ifdef MYMATH_USE_SSE
+    explicit quatf(const __m128 v) { _mm_store_ps(&x, v); }
+
+    inline __m128 simd() const { return _mm_load_ps(&x); }
+#endif
 
     inline float operator[](const size_t index) const {
         DebugAssert(index == 0 || index == 1 || index == 2 || index == 3);
@@ -368,11 +406,19 @@ struct MYMATH_ALIGN_FOR_SSE quatf {
     }
 
     // this is not a conjugate !!!
+#ifdef MYMATH_USE_SSE
+    inline quatf operator-() const { return quatf(_mm_xor_ps(this->simd(), _mm_set1_ps(-0.0f))); }
+    inline quatf operator*(const float f) const { return quatf(_mm_mul_ps(this->simd(), _mm_set1_ps(f))); }
+    inline quatf operator/(const float f) const { return quatf(_mm_div_ps(this->simd(), _mm_set1_ps(f))); }
+    inline quatf operator+(const quatf& other) const { return quatf(_mm_add_ps(this->simd(), other.simd())); }
+    inline quatf operator-(const quatf& other) const { return quatf(_mm_sub_ps(this->simd(), other.simd())); }
+#else
     inline quatf operator-() const { return quatf(-x, -y, -z, -w); }
     inline quatf operator*(const float f) const { return quatf(x * f, y * f, z * f, w * f); }
     inline quatf operator/(const float f) const { return quatf(x / f, y / f, z / f, w / f); }
     inline quatf operator+(const quatf& other) const { return quatf(x + other.x, y + other.y, z + other.z, w + other.w); }
     inline quatf operator-(const quatf& other) const { return quatf(x - other.x, y - other.y, z - other.z, w - other.w); }
+#endif
     inline quatf operator*(const quatf& other) const {
         return quatf(w * other.x + x * other.w + y * other.z - z * other.y,
                      w * other.y + y * other.w + z * other.x - x * other.z,
@@ -397,6 +443,16 @@ struct MYMATH_ALIGN_FOR_SSE quatf {
         );
     }
 
+    inline quatf& operator*=(const quatf& other) {
+        *this = *this * other;
+        return *this;
+    }
+#ifdef MYMATH_USE_SSE
+    inline quatf& operator+=(const quatf& other) { return *this = *this + other; }
+    inline quatf& operator-=(const quatf& other) { return *this = *this - other; }
+    inline quatf& operator*=(const float f) { return *this = *this * f; }
+    inline quatf& operator/=(const float f) { return *this = *this / f; }
+#else
     inline quatf& operator+=(const quatf& other) {
         x += other.x;
         y += other.y;
@@ -411,10 +467,6 @@ struct MYMATH_ALIGN_FOR_SSE quatf {
         w -= other.w;
         return *this;
     }
-    inline quatf& operator*=(const quatf& other) {
-        *this = *this * other;
-        return *this;
-    }
     inline quatf& operator*=(const float f) {
         x *= f;
         y *= f;
@@ -429,9 +481,10 @@ struct MYMATH_ALIGN_FOR_SSE quatf {
         w /= f;
         return *this;
     }
+#endif
 
     friend inline quatf operator*(const float f, const quatf& q) {
-        return quatf(f * q.x, f * q.y, f * q.z, f * q.w);
+        return q * f;
     }
     friend inline vec3f operator*(const vec3f& v, const quatf& q) {
         return q * v;
@@ -495,6 +548,12 @@ struct MYMATH_ALIGN_FOR_SSE quatf {
 
         return (from * scale0) + (temp * scale1);
     }
+
+    // cheap approximation of slerp, good for close rotations
+    static quatf nlerp(const quatf& from, const quatf& to, const float t) {
+        const quatf temp = (quatf::dot(from, to) < 0.0f) ? -to : to;
+        return quatf::normalize((from * (1.0f - t)) + (temp * t));
+    }
 };
 
 // row-major
@@ -524,6 +583,21 @@ struct MYMATH_ALIGN_FOR_SSE mat4f {
     }
     inline mat4f operator*(const mat4f& other) const {
         mat4f result;
+#ifdef MYMATH_USE_SSE
+        // every result row is the other's rows weighted by this row, summed in the same order as the scalar dot
+        const __m128 other0 = other.m[0].simd();
+        const __m128 other1 = other.m[1].simd();
+        const __m128 other2 = other.m[2].simd();
+        const __m128 other3 = other.m[3].simd();
+        for (size_t i = 0; i < 4; ++i) {
+            const __m128 row = m[i].simd();
+            __m128 sum = _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(0, 0, 0, 0)), other0);
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(1, 1, 1, 1)), other1));
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(2, 2, 2, 2)), other2));
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(3, 3, 3, 3)), other3));
+            result.m[i] = vec4f(sum);
+        }
+#else
         result.m[0][0] = m[0][0] * other.m[0][0] + m[0][1] * other.m[1][0] + m[0][2] * other.m[2][0] + m[0][3] * other.m[3][0];
         result.m[0][1] = m[0][0] * other.m[0][1] + m[0][1] * other.m[1][1] + m[0][2] * other.m[2][1] + m[0][3] * other.m[3][1];
         result.m[0][2] = m[0][0] * other.m[0][2] + m[0][1] * other.m[1][2] + m[0][2] * other.m[2][2] + m[0][3] * other.m[3][2];
@@ -540,13 +614,25 @@ struct MYMATH_ALIGN_FOR_SSE mat4f {
         result.m[3][1] = m[3][0] * other.m[0][1] + m[3][1] * other.m[1][1] + m[3][2] * other.m[2][1] + m[3][3] * other.m[3][1];
         result.m[3][2] = m[3][0] * other.m[0][2] + m[3][1] * other.m[1][2] + m[3][2] * other.m[2][2] + m[3][3] * other.m[3][2];
         result.m[3][3] = m[3][0] * other.m[0][3] + m[3][1] * other.m[1][3] + m[3][2] * other.m[2][3] + m[3][3] * other.m[3][3];
+#endif
         return result;
     }
     inline vec4f operator*(const vec4f& v) const {
+#ifdef MYMATH_USE_SSE
+        // products are transposed, so every dot is summed x + y + z + w left to right, just like vec4f::dot does
+        const __m128 v4 = v.simd();
+        __m128 p0 = _mm_mul_ps(v4, m[0].simd());
+        __m128 p1 = _mm_mul_ps(v4, m[1].simd());
+        __m128 p2 = _mm_mul_ps(v4, m[2].simd());
+        __m128 p3 = _mm_mul_ps(v4, m[3].simd());
+        _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+        return vec4f(_mm_add_ps(_mm_add_ps(_mm_add_ps(p0, p1), p2), p3));
+#else
         return vec4f(vec4f::dot(v, m[0]),
                      vec4f::dot(v, m[1]),
                      vec4f::dot(v, m[2]),
                      vec4f::dot(v, m[3]));
+#endif
     }
 
     inline mat4f& operator*=(const float f) {
@@ -575,6 +661,8 @@ struct MYMATH_ALIGN_FOR_SSE mat4f {
         return *this;
     }
 
+    // these two stay scalar, mymath-bench times an SSE version (same sums, so a transpose per call) against them,
+    // it is slower one vertex at a time, and much slower in the skinning loop, which the compiler vectorizes as is
     inline vec3f transformPos(const vec3f& pos) const {
         vec4f v4(pos.x, pos.y, pos.z, 1.0f);
         return vec3f(vec4f::dot(v4, m[0]),
@@ -697,6 +785,26 @@ struct MYMATH_ALIGN_FOR_SSE mat4f {
     }
 
     static mat4f fromQuatAndPos(const quatf& q, const vec3f& p) {
+#ifdef MYMATH_USE_SSE
+        // same products and sums as below, the diagonal and the off-diagonal pairs are done three at a time
+        const __m128 q4 = q.simd();
+        const __m128 q2 = _mm_add_ps(q4, q4);
+        const __m128 sq = _mm_mul_ps(q4, q2);                                                   // xx yy zz
+        const __m128 offA = _mm_mul_ps(_mm_shuffle_ps(q4, q4, _MM_SHUFFLE(3, 1, 0, 0)),
+                                       _mm_shuffle_ps(q2, q2, _MM_SHUFFLE(3, 2, 2, 1)));       // xy xz yz
+        const __m128 offB = _mm_mul_ps(_mm_shuffle_ps(q4, q4, _MM_SHUFFLE(3, 3, 3, 3)),
+                                       _mm_shuffle_ps(q2, q2, _MM_SHUFFLE(3, 0, 1, 2)));       // wz wy wx
+        const __m128 sum = _mm_add_ps(_mm_shuffle_ps(sq, sq, _MM_SHUFFLE(3, 0, 0, 1)),
+                                      _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(3, 1, 2, 2)));        // yy+zz xx+zz xx+yy
+        const vec4f diag(_mm_sub_ps(_mm_set1_ps(1.0f), sum));
+        const vec4f plus(_mm_add_ps(offA, offB));
+        const vec4f minus(_mm_sub_ps(offA, offB));
+
+        return mat4f(vec4f(  diag.x, minus.x,  plus.y,   p.x),
+                     vec4f(  plus.x,  diag.y, minus.z,   p.y),
+                     vec4f( minus.y,  plus.z,  diag.z,   p.z),
+                     vec4f(    0.0f,    0.0f,    0.0f,  1.0f));
+#else
         const float x2 = q.x + q.x;
         const float y2 = q.y + q.y;
         const float z2 = q.z + q.z;
@@ -714,6 +822,7 @@ struct MYMATH_ALIGN_FOR_SSE mat4f {
                      vec4f(         xy + wz, 1.0f - (xx + zz),          yz - wx,   p.y),
                      vec4f(         xz - wy,          yz + wx, 1.0f - (xx + yy),   p.z),
                      vec4f(            0.0f,             0.0f,             0.0f,  1.0f));
+#endif
     }
 
     static mat4f fromQuat(const quatf& q) {
@@ -762,8 +871,8 @@ struct AABBox {
     }
 
     inline float MaximumValue() const {
-        return std::max(Max3(std::fabsf(minimum.x), std::fabsf(minimum.y), std::fabsf(minimum.z)),
-                        Max3(std::fabsf(maximum.x), std::fabsf(maximum.y), std::fabsf(maximum.z)));
+        return std::max(Max3(std::fabs(minimum.x), std::fabs(minimum.y), std::fabs(minimum.z)),
+                        Max3(std::fabs(maximum.x), std::fabs(maximum.y), std::fabs(maximum.z)));
     }
 };
 
@@ -771,7 +880,7 @@ struct AABBox {
 // http://jcgt.org/published/0006/01/01/
 // branchlessONB
 inline void OrthonormalBasis(const vec3f& n, vec3f& b1, vec3f& b2) {
-    const float sign = std::copysignf(1.0f, n.z);
+    const float sign = std::copysign(1.0f, n.z);
     const float a = -1.0f / (sign + n.z);
     const float b = n.x * n.y * a;
     b1 = vec3f(1.0f + sign * n.x * n.x * a, sign * b, -sign * n.x);
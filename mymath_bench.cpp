@@ -0,0 +1,154 @@
+#include "mycommon.h"
+#include "mymath.h"
+
+#include <chrono>
+#include <cstdio>
+
+// mymath.h micro-benchmarks, built twice like mymath-test, run both builds to compare the SIMD and the scalar code
+// every operation runs over arrays of inputs, so the numbers are throughput, printed as JSON lines
+// usage: mymath-bench [repeats]
+
+#ifdef MYMATH_USE_SSE
+static const char* kBackendName = "sse";
+#else
+static const char* kBackendName = "scalar";
+#endif
+
+static constexpr size_t kNumInputs  = 1024;
+static constexpr size_t kNumSamples = 9;
+
+using BenchClock = std::chrono::steady_clock;
+
+
+struct BenchData {
+    MyArray<float>  floats;
+    MyArray<vec3f>  vec3A;
+    MyArray<vec4f>  vec4A;
+    MyArray<vec4f>  vec4B;
+    MyArray<quatf>  quatA;
+    MyArray<quatf>  quatB;
+    MyArray<mat4f>  matA;
+    MyArray<mat4f>  matB;
+
+    MyArray<vec3f>  vec3Out;
+    MyArray<vec4f>  vec4Out;
+    MyArray<quatf>  quatOut;
+    MyArray<mat4f>  matOut;
+
+    BenchData() {
+        std::mt19937 gen(0x6D796D61);
+        auto rnd = [&gen](const float lo, const float hi) {
+            return lo + (hi - lo) * (scast<float>(gen() >> 8) * (1.0f / 16777216.0f));
+        };
+
+        floats.resize(kNumInputs);
+        vec3A.resize(kNumInputs);
+        vec4A.resize(kNumInputs);
+        vec4B.resize(kNumInputs);
+        quatA.resize(kNumInputs);
+        quatB.resize(kNumInputs);
+        matA.resize(kNumInputs);
+        matB.resize(kNumInputs);
+        for (size_t i = 0; i < kNumInputs; ++i) {
+            floats[i] = rnd(0.5f, 2.0f);
+            vec3A[i] = vec3f(rnd(-100.0f, 100.0f), rnd(-100.0f, 100.0f), rnd(-100.0f, 100.0f));
+            vec4A[i] = vec4f(rnd(-100.0f, 100.0f), rnd(-100.0f, 100.0f), rnd(-100.0f, 100.0f), rnd(-100.0f, 100.0f));
+            vec4B[i] = vec4f(rnd(0.5f, 2.0f), rnd(0.5f, 2.0f), rnd(0.5f, 2.0f), rnd(0.5f, 2.0f));
+            quatA[i] = quatf::normalize(quatf(rnd(-1.0f, 1.0f), rnd(-1.0f, 1.0f), rnd(-1.0f, 1.0f), rnd(-1.0f, 1.0f)));
+            quatB[i] = quatf::normalize(quatf(rnd(-1.0f, 1.0f), rnd(-1.0f, 1.0f), rnd(-1.0f, 1.0f), rnd(-1.0f, 1.0f)));
+            // bone-like transforms, so chains of multiplies stay in range
+            matA[i] = mat4f::fromQuatAndPos(quatA[i], vec3A[i]);
+            matB[i] = mat4f::fromQuatAndPos(quatB[i], vec3A[kNumInputs - 1 - i]);
+        }
+
+        vec3Out.resize(kNumInputs);
+        vec4Out.resize(kNumInputs);
+        quatOut.resize(kNumInputs);
+        matOut.resize(kNumInputs);
+    }
+
+    uint64_t Checksum() const {
+        uint64_t h = HashBytes(vec3Out.data(), vec3Out.size() * sizeof(vec3f));
+        h = HashBytes(vec4Out.data(), vec4Out.size() * sizeof(vec4f), h);
+        h = HashBytes(quatOut.data(), quatOut.size() * sizeof(quatf), h);
+        return HashBytes(matOut.data(), matOut.size() * sizeof(mat4f), h);
+    }
+};
+
+
+#ifdef MYMATH_USE_SSE
+// the SSE transformPos that mymath.h does not use, kept here to show why, sums in the scalar order need a transpose
+static vec3f TransformPosSSE(const mat4f& mat, const vec3f& pos) {
+    const __m128 v4 = _mm_set_ps(1.0f, pos.z, pos.y, pos.x);
+    __m128 p0 = _mm_mul_ps(v4, mat.m[0].simd());
+    __m128 p1 = _mm_mul_ps(v4, mat.m[1].simd());
+    __m128 p2 = _mm_mul_ps(v4, mat.m[2].simd());
+    __m128 p3 = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(p0, p1, p2, p3);
+    const vec4f result(_mm_add_ps(_mm_add_ps(_mm_add_ps(p0, p1), p2), p3));
+    return vec3f(result.x, result.y, result.z);
+}
+#endif
+
+// every entry runs its operation once over all the inputs
+struct BenchOp {
+    const char* name;
+    void        (*run)(BenchData& d);
+};
+
+static const BenchOp kBenchOps[] = {
+    { "vec4f a + b",        [](BenchData& d) { for (size_t i = 0; i < kNumInputs; ++i) { d.vec4Out[i] = d.vec4A[i] + d.vec4B[i]; } } },
+    { "vec4f a * b",        [](BenchData& d) { for (size_t i = 0; i < kNumInputs; ++i) { d.vec4Out[i] = d.vec4A[i] * d.vec4B[i]; } } },
+    { "vec4f a * f",        [](BenchData& d) { for (size_t i = 0; i < kNumInputs; ++i) { d.vec4Out[i] = d.vec4A[i] * d.floats[i]; } } },
+    { "vec4f a / b",        [](BenchData& d) { for (size_t i = 0; i < kNumInputs; ++i) { d.vec4Out[i] = d.vec4A[i] / d.vec4B[i]; } } },
+    { "vec4f a += b",       [](BenchData& d) { for (size_t i = 0; i < kNumInputs; ++i) { d.vec4Out[i] += d.vec4B[i]; } } },
+    { "vec4f normalize",    [](BenchData& d) { for (size_t i = 0; i < kNumInputs; ++i) { d.vec4Out[i] = vec4f::normalize(d.vec4A[i]); } } },
+    { "quatf q + r",        [](BenchData& d) { for (size_t i = 0; i < kNumInputs; ++i) { d.quatOut[i] = d.quatA[i] + d.quatB[i]; } } },
+    { "quatf q * f",        [](BenchData& d) { for (size_t i = 0; i < kNumInputs; ++i) { d.quatOut[i] = d.quatA[i] * d.floats[i]; } } },
+    { "quatf q * r",        [](BenchData& d) { for (size_t i = 0; i < kNumInputs; ++i) { d.quatOut[i] = d.quatA[i] * d.quatB[i]; } } },
+    { "quatf normalize",    [](BenchData& d) { for (size_t i = 0; i < kNumInputs; ++i) { d.quatOut[i] = quatf::normalize(d.quatA[i]); } } },
+    { "quatf slerp",        [](BenchData& d) { for (size_t i = 0; i < kNumInputs; ++i) { d.quatOut[i] = quatf::slerp(d.quatA[i], d.quatB[i], d.floats[i] - 0.5f); } } },
+    { "quatf nlerp",        [](BenchData& d) { for (size_t i = 0; i < kNumInputs; ++i) { d.quatOut[i] = quatf::nlerp(d.quatA[i], d.quatB[i], d.floats[i] - 0.5f); } } },
+    { "mat4f m * n",        [](BenchData& d) { for (size_t i = 0; i < kNumInputs; ++i) { d.matOut[i] = d.matA[i] * d.matB[i]; } } },
+    { "mat4f m * v",        [](BenchData& d) { for (size_t i = 0; i < kNumInputs; ++i) { d.vec4Out[i] = d.matA[i] * d.vec4A[i]; } } },
+    { "mat4f transformPos", [](BenchData& d) { for (size_t i = 0; i < kNumInputs; ++i) { d.vec3Out[i] = d.matA[i].transformPos(d.vec3A[i]); } } },
+    { "mat4f transformDir", [](BenchData& d) { for (size_t i = 0; i < kNumInputs; ++i) { d.vec3Out[i] = d.matA[i].transformDir(d.vec3A[i]); } } },
+    // the skinning loop, many vertices through one bone
+    { "mat4f transformPos one bone", [](BenchData& d) { const mat4f& bone = d.matA[0]; for (size_t i = 0; i < kNumInputs; ++i) { d.vec3Out[i] = bone.transformPos(d.vec3A[i]); } } },
+#ifdef MYMATH_USE_SSE
+    { "mat4f transformPos sse candidate", [](BenchData& d) { for (size_t i = 0; i < kNumInputs; ++i) { d.vec3Out[i] = TransformPosSSE(d.matA[i], d.vec3A[i]); } } },
+    { "mat4f transformPos one bone sse candidate", [](BenchData& d) { const mat4f& bone = d.matA[0]; for (size_t i = 0; i < kNumInputs; ++i) { d.vec3Out[i] = TransformPosSSE(bone, d.vec3A[i]); } } },
+#endif
+    { "mat4f fromQuatAndPos", [](BenchData& d) { for (size_t i = 0; i < kNumInputs; ++i) { d.matOut[i] = mat4f::fromQuatAndPos(d.quatA[i], d.vec3A[i]); } } },
+    // what the skeleton evaluation does per bone
+    { "bone local to world", [](BenchData& d) { for (size_t i = 0; i < kNumInputs; ++i) { d.matOut[i] = d.matA[i] * mat4f::fromQuatAndPos(d.quatA[i], d.vec3A[i]); } } },
+};
+
+
+static double MeasureNsPerOp(const BenchOp& op, BenchData& data, const size_t repeats) {
+    double best = 0.0;
+    for (size_t sample = 0; sample < kNumSamples; ++sample) {
+        const BenchClock::time_point start = BenchClock::now();
+        for (size_t i = 0; i < repeats; ++i) {
+            op.run(data);
+        }
+        const double ns = std::chrono::duration<double, std::nano>(BenchClock::now() - start).count();
+        best = sample ? std::min(best, ns) : ns;
+    }
+    return best / scast<double>(repeats * kNumInputs);
+}
+
+int main(int argc, char** argv) {
+    const size_t repeats = (argc > 1) ? scast<size_t>(std::max(1, std::atoi(argv[1]))) : 2000;
+
+    BenchData data;
+    for (const BenchOp& op : kBenchOps) {
+        op.run(data);   // warm up
+        const double nsPerOp = MeasureNsPerOp(op, data, repeats);
+        printf("{\"backend\":\"%s\",\"op\":\"%s\",\"nsPerOp\":%.3f}\n", kBackendName, op.name, nsPerOp);
+    }
+
+    fprintf(stderr, "%s backend, %zu ops x %zu inputs x %zu repeats, checksum %016llx\n",
+            kBackendName, std::size(kBenchOps), kNumInputs, repeats, scast<unsigned long long>(data.Checksum()));
+    return 0;
+}
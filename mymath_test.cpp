@@ -0,0 +1,309 @@
+#include "mycommon.h"
+#include "mymath.h"
+
+#include <cstdio>
+#include <fstream>
+
+// mymath.h bit-compatibility check, this file is built twice, with and without MYMATH_NO_SIMD
+// every operation is run on the same pseudo-random inputs in both builds and the raw result bits must match
+// usage: mymath-test --write results.bin      (dumps the results of this build)
+//        mymath-test --compare results.bin    (fails if any result differs from the dumped ones)
+
+#ifdef MYMATH_USE_SSE
+static const char* kBackendName = "sse";
+#else
+static const char* kBackendName = "scalar";
+#endif
+
+static constexpr size_t kNumCases = 4096;
+
+
+// deterministic inputs that go through no mymath.h code, so they are the same in every build
+class TestRandom {
+public:
+    explicit TestRandom(const uint64_t seed)
+        : mGen(scast<std::mt19937::result_type>(seed ^ (seed >> 32)))
+    {
+    }
+
+    // mostly plain values, with signed zeros and tiny and huge magnitudes mixed in
+    float Float() {
+        const uint32_t kind = mGen() % 64;
+        if (kind == 0) {
+            return 0.0f;
+        } else if (kind == 1) {
+            return -0.0f;
+        } else if (kind == 2) {
+            return this->Range(-1e-30f, 1e-30f);
+        } else if (kind == 3) {
+            return this->Range(-1e30f, 1e30f);
+        }
+        return this->Range(-100.0f, 100.0f);
+    }
+    float NonZero() {
+        const float f = this->Range(0.25f, 4.0f);
+        return (mGen() & 1) ? -f : f;
+    }
+    float Range(const float lo, const float hi) {
+        return lo + (hi - lo) * (scast<float>(mGen() >> 8) * (1.0f / 16777216.0f));
+    }
+
+    vec3f Vec3() {
+        const float x = this->Float();
+        const float y = this->Float();
+        const float z = this->Float();
+        return vec3f(x, y, z);
+    }
+    vec4f Vec4() {
+        const float x = this->Float();
+        const float y = this->Float();
+        const float z = this->Float();
+        const float w = this->Float();
+        return vec4f(x, y, z, w);
+    }
+    vec4f NonZeroVec4() {
+        const float x = this->NonZero();
+        const float y = this->NonZero();
+        const float z = this->NonZero();
+        const float w = this->NonZero();
+        return vec4f(x, y, z, w);
+    }
+    quatf Quat() {
+        const float x = this->Range(-1.0f, 1.0f);
+        const float y = this->Range(-1.0f, 1.0f);
+        const float z = this->Range(-1.0f, 1.0f);
+        const float w = this->Range(-1.0f, 1.0f);
+        return quatf(x, y, z, w);
+    }
+    // a rotation, normalized without going through quatf's operators
+    quatf UnitQuat() {
+        const quatf q = this->Quat();
+        const float invLength = 1.0f / std::sqrt(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+        return quatf(q.x * invLength, q.y * invLength, q.z * invLength, q.w * invLength);
+    }
+    // half of the time nearly the same rotation, so slerp takes its linear branch too
+    quatf NearbyQuat(const quatf& q) {
+        if (mGen() & 1) {
+            return this->UnitQuat();
+        }
+        const float e = 1e-4f;
+        return quatf(q.x + this->Range(-e, e), q.y + this->Range(-e, e), q.z + this->Range(-e, e), q.w + this->Range(-e, e));
+    }
+    mat4f Mat() {
+        const vec4f row0 = this->Vec4();
+        const vec4f row1 = this->Vec4();
+        const vec4f row2 = this->Vec4();
+        const vec4f row3 = this->Vec4();
+        return mat4f(row0, row1, row2, row3);
+    }
+    // a bone-like transform, rotation and scale in the 3x3 part, translation in the last column
+    mat4f Affine() {
+        mat4f result;
+        for (size_t i = 0; i < 3; ++i) {
+            for (size_t j = 0; j < 3; ++j) {
+                result.m[i][j] = this->Range(-2.0f, 2.0f);
+            }
+            result.m[i][3] = this->Range(-100.0f, 100.0f);
+        }
+        result.m[3] = vec4f(0.0f, 0.0f, 0.0f, 1.0f);
+        return result;
+    }
+
+private:
+    std::mt19937    mGen;
+};
+
+
+using ResultBits = MyArray<uint32_t>;
+
+static void Put(ResultBits& out, const float f) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    out.push_back(bits);
+}
+static void Put(ResultBits& out, const vec3f& v) {
+    Put(out, v.x);
+    Put(out, v.y);
+    Put(out, v.z);
+}
+static void Put(ResultBits& out, const vec4f& v) {
+    Put(out, v.x);
+    Put(out, v.y);
+    Put(out, v.z);
+    Put(out, v.w);
+}
+static void Put(ResultBits& out, const quatf& q) {
+    Put(out, q.x);
+    Put(out, q.y);
+    Put(out, q.z);
+    Put(out, q.w);
+}
+static void Put(ResultBits& out, const mat4f& mat) {
+    for (const vec4f& row : mat.m) {
+        Put(out, row);
+    }
+}
+
+
+struct TestOp {
+    const char*                                     name;
+    std::function<void(TestRandom&, ResultBits&)>   run;
+};
+
+static const TestOp kTestOps[] = {
+    { "vec4f -a",           [](TestRandom& rnd, ResultBits& out) { const vec4f a = rnd.Vec4(); Put(out, -a); } },
+    { "vec4f a * f",        [](TestRandom& rnd, ResultBits& out) { const vec4f a = rnd.Vec4(); const float f = rnd.Float(); Put(out, a * f); } },
+    { "vec4f f * a",        [](TestRandom& rnd, ResultBits& out) { const vec4f a = rnd.Vec4(); const float f = rnd.Float(); Put(out, f * a); } },
+    { "vec4f a / f",        [](TestRandom& rnd, ResultBits& out) { const vec4f a = rnd.Vec4(); const float f = rnd.NonZero(); Put(out, a / f); } },
+    { "vec4f a + b",        [](TestRandom& rnd, ResultBits& out) { const vec4f a = rnd.Vec4(); const vec4f b = rnd.Vec4(); Put(out, a + b); } },
+    { "vec4f a - b",        [](TestRandom& rnd, ResultBits& out) { const vec4f a = rnd.Vec4(); const vec4f b = rnd.Vec4(); Put(out, a - b); } },
+    { "vec4f a * b",        [](TestRandom& rnd, ResultBits& out) { const vec4f a = rnd.Vec4(); const vec4f b = rnd.Vec4(); Put(out, a * b); } },
+    { "vec4f a / b",        [](TestRandom& rnd, ResultBits& out) { const vec4f a = rnd.Vec4(); const vec4f b = rnd.NonZeroVec4(); Put(out, a / b); } },
+    { "vec4f a += b",       [](TestRandom& rnd, ResultBits& out) { vec4f a = rnd.Vec4(); const vec4f b = rnd.Vec4(); a += b; Put(out, a); } },
+    { "vec4f a -= b",       [](TestRandom& rnd, ResultBits& out) { vec4f a = rnd.Vec4(); const vec4f b = rnd.Vec4(); a -= b; Put(out, a); } },
+    { "vec4f a *= b",       [](TestRandom& rnd, ResultBits& out) { vec4f a = rnd.Vec4(); const vec4f b = rnd.Vec4(); a *= b; Put(out, a); } },
+    { "vec4f a /= b",       [](TestRandom& rnd, ResultBits& out) { vec4f a = rnd.Vec4(); const vec4f b = rnd.NonZeroVec4(); a /= b; Put(out, a); } },
+    { "vec4f a *= f",       [](TestRandom& rnd, ResultBits& out) { vec4f a = rnd.Vec4(); const float f = rnd.Float(); a *= f; Put(out, a); } },
+    { "vec4f a /= f",       [](TestRandom& rnd, ResultBits& out) { vec4f a = rnd.Vec4(); const float f = rnd.NonZero(); a /= f; Put(out, a); } },
+    { "vec4f dot",          [](TestRandom& rnd, ResultBits& out) { const vec4f a = rnd.Vec4(); const vec4f b = rnd.Vec4(); Put(out, vec4f::dot(a, b)); } },
+    { "vec4f normalize",    [](TestRandom& rnd, ResultBits& out) { const vec4f a = rnd.NonZeroVec4(); Put(out, vec4f::normalize(a)); } },
+
+    { "quatf -q",           [](TestRandom& rnd, ResultBits& out) { const quatf a = rnd.Quat(); Put(out, -a); } },
+    { "quatf q * f",        [](TestRandom& rnd, ResultBits& out) { const quatf a = rnd.Quat(); const float f = rnd.Float(); Put(out, a * f); } },
+    { "quatf q / f",        [](TestRandom& rnd, ResultBits& out) { const quatf a = rnd.Quat(); const float f = rnd.NonZero(); Put(out, a / f); } },
+    { "quatf q + r",        [](TestRandom& rnd, ResultBits& out) { const quatf a = rnd.Quat(); const quatf b = rnd.Quat(); Put(out, a + b); } },
+    { "quatf q - r",        [](TestRandom& rnd, ResultBits& out) { const quatf a = rnd.Quat(); const quatf b = rnd.Quat(); Put(out, a - b); } },
+    { "quatf q += r",       [](TestRandom& rnd, ResultBits& out) { quatf a = rnd.Quat(); const quatf b = rnd.Quat(); a += b; Put(out, a); } },
+    { "quatf q -= r",       [](TestRandom& rnd, ResultBits& out) { quatf a = rnd.Quat(); const quatf b = rnd.Quat(); a -= b; Put(out, a); } },
+    { "quatf q *= f",       [](TestRandom& rnd, ResultBits& out) { quatf a = rnd.Quat(); const float f = rnd.Float(); a *= f; Put(out, a); } },
+    { "quatf q /= f",       [](TestRandom& rnd, ResultBits& out) { quatf a = rnd.Quat(); const float f = rnd.NonZero(); a /= f; Put(out, a); } },
+    { "quatf q * r",        [](TestRandom& rnd, ResultBits& out) { const quatf a = rnd.UnitQuat(); const quatf b = rnd.UnitQuat(); Put(out, a * b); } },
+    { "quatf q * v",        [](TestRandom& rnd, ResultBits& out) { const quatf a = rnd.UnitQuat(); const vec3f v = rnd.Vec3(); Put(out, a * v); } },
+    { "quatf normalize",    [](TestRandom& rnd, ResultBits& out) { const quatf a = rnd.Quat(); Put(out, quatf::normalize(a)); } },
+    { "quatf slerp",        [](TestRandom& rnd, ResultBits& out) { const quatf a = rnd.UnitQuat(); const quatf b = rnd.NearbyQuat(a); const float t = rnd.Range(0.0f, 1.0f); Put(out, quatf::slerp(a, b, t)); } },
+    { "quatf nlerp",        [](TestRandom& rnd, ResultBits& out) { const quatf a = rnd.UnitQuat(); const quatf b = rnd.NearbyQuat(a); const float t = rnd.Range(0.0f, 1.0f); Put(out, quatf::nlerp(a, b, t)); } },
+
+    { "mat4f m * f",        [](TestRandom& rnd, ResultBits& out) { const mat4f a = rnd.Mat(); const float f = rnd.Float(); Put(out, a * f); } },
+    { "mat4f m * n",        [](TestRandom& rnd, ResultBits& out) { const mat4f a = rnd.Mat(); const mat4f b = rnd.Mat(); Put(out, a * b); } },
+    { "mat4f bone * bone",  [](TestRandom& rnd, ResultBits& out) { const mat4f a = rnd.Affine(); const mat4f b = rnd.Affine(); Put(out, a * b); } },
+    { "mat4f m *= n",       [](TestRandom& rnd, ResultBits& out) { mat4f a = rnd.Mat(); const mat4f b = rnd.Mat(); a *= b; Put(out, a); } },
+    { "mat4f m * v",        [](TestRandom& rnd, ResultBits& out) { const mat4f a = rnd.Mat(); const vec4f v = rnd.Vec4(); Put(out, a * v); } },
+    { "mat4f transformPos", [](TestRandom& rnd, ResultBits& out) { const mat4f a = rnd.Mat(); const vec3f v = rnd.Vec3(); Put(out, a.transformPos(v)); } },
+    { "mat4f transformDir", [](TestRandom& rnd, ResultBits& out) { const mat4f a = rnd.Mat(); const vec3f v = rnd.Vec3(); Put(out, a.transformDir(v)); } },
+    { "mat4f fromQuatAndPos", [](TestRandom& rnd, ResultBits& out) { const quatf q = rnd.UnitQuat(); const vec3f p = rnd.Vec3(); Put(out, mat4f::fromQuatAndPos(q, p)); } },
+    { "mat4f fromQuatAndPos unnormalized", [](TestRandom& rnd, ResultBits& out) { const quatf q = rnd.Quat(); const vec3f p = rnd.Vec3(); Put(out, mat4f::fromQuatAndPos(q, p)); } },
+    { "mat4f inverse",      [](TestRandom& rnd, ResultBits& out) { const mat4f a = rnd.Affine(); Put(out, mat4f::inverse(a)); } },
+};
+
+
+static ResultBits RunTestOp(const TestOp& op) {
+    // every operation gets its own inputs, so adding one does not shift the others
+    TestRandom rnd(HashBytes(op.name, std::strlen(op.name)));
+    ResultBits result;
+    for (size_t i = 0; i < kNumCases; ++i) {
+        op.run(rnd, result);
+    }
+    return result;
+}
+
+// file layout: per operation, u32 name length, name, u64 results count, u32 results
+static bool WriteResults(const fs::path& path) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    for (const TestOp& op : kTestOps) {
+        const ResultBits bits = RunTestOp(op);
+        const uint32_t nameLength = scast<uint32_t>(std::strlen(op.name));
+        const uint64_t count = bits.size();
+        file.write(rcast<const char*>(&nameLength), sizeof(nameLength));
+        file.write(op.name, nameLength);
+        file.write(rcast<const char*>(&count), sizeof(count));
+        file.write(rcast<const char*>(bits.data()), count * sizeof(uint32_t));
+    }
+    file.close();
+    return !file.fail();
+}
+
+static bool ReadResults(const fs::path& path, MyDict<CharString, ResultBits>& results) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+
+    uint32_t nameLength;
+    while (file.read(rcast<char*>(&nameLength), sizeof(nameLength))) {
+        CharString name(nameLength, '\0');
+        uint64_t count = 0;
+        file.read(name.data(), nameLength);
+        file.read(rcast<char*>(&count), sizeof(count));
+        if (!file || count > kNumCases * 64) {
+            return false;
+        }
+
+        ResultBits& bits = results[name];
+        bits.resize(scast<size_t>(count));
+        if (!file.read(rcast<char*>(bits.data()), count * sizeof(uint32_t))) {
+            return false;
+        }
+    }
+    return file.eof();
+}
+
+static int CompareResults(const fs::path& path) {
+    MyDict<CharString, ResultBits> expected;
+    if (!ReadResults(path, expected)) {
+        fprintf(stderr, "mymath-test: can't read %s\n", path.string().c_str());
+        return 1;
+    }
+
+    size_t numFailed = 0;
+    for (const TestOp& op : kTestOps) {
+        const ResultBits bits = RunTestOp(op);
+        auto it = expected.find(op.name);
+        if (it == expected.end()) {
+            fprintf(stderr, "FAIL %s: missing from %s\n", op.name, path.string().c_str());
+            ++numFailed;
+            continue;
+        }
+
+        const ResultBits& other = it->second;
+        if (other.size() != bits.size()) {
+            fprintf(stderr, "FAIL %s: %zu results, expected %zu\n", op.name, bits.size(), other.size());
+            ++numFailed;
+            continue;
+        }
+
+        size_t numDiffs = 0, firstDiff = 0;
+        for (size_t i = 0; i < bits.size(); ++i) {
+            if (bits[i] != other[i]) {
+                firstDiff = numDiffs ? firstDiff : i;
+                ++numDiffs;
+            }
+        }
+        if (numDiffs) {
+            fprintf(stderr, "FAIL %s: %zu of %zu floats differ, first at %zu: 0x%08x, expected 0x%08x\n",
+                    op.name, numDiffs, bits.size(), firstDiff, bits[firstDiff], other[firstDiff]);
+            ++numFailed;
+        } else {
+            printf("ok   %s\n", op.name);
+        }
+    }
+
+    printf("%s backend: %zu of %zu operations bit-identical\n", kBackendName, std::size(kTestOps) - numFailed, std::size(kTestOps));
+    return numFailed ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 3 && !std::strcmp(argv[1], "--write")) {
+        if (!WriteResults(argv[2])) {
+            fprintf(stderr, "mymath-test: can't write %s\n", argv[2]);
+            return 1;
+        }
+        printf("%s backend: %zu operations written to %s\n", kBackendName, std::size(kTestOps), argv[2]);
+        return 0;
+    } else if (argc == 3 && !std::strcmp(argv[1], "--compare")) {
+        return CompareResults(argv[2]);
+    }
+
+    fprintf(stderr, "usage: mymath-test --write results.bin\n"
+                    "       mymath-test --compare results.bin\n");
+    return 1;
+}
@@ -40,7 +40,9 @@ RenderView::RenderView(QWidget* parent)
     , mFPSMeter{}
     , mShowStats(true)
     , mBackgroundColor(40.0f / 255.0f, 113.0f / 255.0f, 134.0f / 255.0f, 0.0f)
+    , mModelInstance(nullptr)
     , mModel(nullptr)
+    , mFirstFramePending(false)
     , mAnimationFrame(0.0f)
     , mShaderModel{}
     , mShaderImage{}
@@ -62,7 +64,7 @@ RenderView::RenderView(QWidget* parent)
 }
 
 RenderView::~RenderView() {
-    mTextures.clear();
+    mResources.reset();
 }
 
 
@@ -148,7 +150,7 @@ void RenderView::paintGL() {
             mvp.ortho(rc);
             mShaderImage->setUniformValue("mvp", mvp);
 
-            const auto& texture = mTextures[mRenderOptions.textureToShow];
+            const auto& texture = mResources->textures[mRenderOptions.textureToShow];
             texture.orig->bind();
 
             glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
@@ -180,7 +182,7 @@ void RenderView::paintGL() {
                     mAnimationFrame -= scast<float>(sequence->GetFramesCount());
                 }
 
-                mModel->CalculateSkeleton(mAnimationFrame, scast<size_t>(mRenderOptions.animSequence));
+                mModelInstance->CalculateSkeleton(mAnimationFrame, scast<size_t>(mRenderOptions.animSequence));
             }
 
             mShaderModel->bind();
@@ -231,14 +233,19 @@ void RenderView::paintGL() {
                     this->BeginDebugDraw(true);
                 }
 
+                constexpr size_t kNoTexture = ~size_t(0);
+                size_t boundTextureIdx = kNoTexture;
+
                 const size_t numBodyParts = mModel->GetBodyPartsCount();
                 for (size_t i = 0; i < numBodyParts; ++i) {
-                    HalfLifeModelBodypart* bodyPart = mModel->GetBodyPart(i);
+                    const HalfLifeModelBodypart* bodyPart = mModel->GetBodyPart(i);
 
-                    const size_t activeSubModel = mModel->GetBodyPartActiveSubModel(i);
-                    HalfLifeModelStudioModel* smdl = bodyPart->GetStudioModel(activeSubModel);
+                    const size_t activeSubModel = mModelInstance->GetBodyPartActiveSubModel(i);
+                    const HalfLifeModelStudioModel* smdl = bodyPart->GetStudioModel(activeSubModel);
 
-                    const uint16_t* indices = smdl->GetIndices();
+                    const uint8_t* indices = scast<const uint8_t*>(smdl->GetIndicesData());
+                    const size_t indexSize = smdl->GetIndexSize();
+                    const GLenum indexType = (indexSize == sizeof(uint32_t)) ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
                     const HalfLifeModelVertex* srcVertices = smdl->GetVertices();
 
                     const vec3f* posPtr = nullptr;
@@ -246,16 +253,24 @@ void RenderView::paintGL() {
                     size_t vertexSize = 0;
 
                     if (mModel->GetBonesCount() > 0) {
-                        const size_t numVertices = smdl->GetVerticesCount();
-                        mRenderVertices.resize(numVertices);
-                        RenderVertex* renderVertices = mRenderVertices.data();
-                        for (size_t k = 0; k < numVertices; ++k) {
-                            const mat4f& boneMat = mModel->GetBoneMat(srcVertices[k].boneIdx);
-                            renderVertices[k].pos = boneMat.transformPos(srcVertices[k].pos);
-                            renderVertices[k].normal = boneMat.transformDir(srcVertices[k].normal);
-                            renderVertices[k].uv = srcVertices[k].uv;
+                        SkinnedBodyPart& skinned = mSkinnedBodyParts[i];
+                        if (skinned.studioModel != smdl || skinned.poseVersion != mModelInstance->GetPoseVersion()) {
+                            const size_t numVertices = smdl->GetVerticesCount();
+                            skinned.vertices.resize(numVertices);
+                            RenderVertex* skinnedVertices = skinned.vertices.data();
+                            for (size_t k = 0; k < numVertices; ++k) {
+                                const mat4f& boneMat = mModelInstance->GetBoneMat(srcVertices[k].boneIdx);
+                                skinnedVertices[k].pos = boneMat.transformPos(srcVertices[k].pos);
+                                skinnedVertices[k].normal = boneMat.transformDir(srcVertices[k].normal);
+                                skinnedVertices[k].uv = srcVertices[k].uv;
+                            }
+
+                            skinned.studioModel = smdl;
+                            skinned.poseVersion = mModelInstance->GetPoseVersion();
                         }
 
+                        const RenderVertex* renderVertices = skinned.vertices.data();
+
                         if (drawCycle == kCycleNormals) {
                             posPtr = &renderVertices->pos;
                             normalsPtr = &renderVertices->normal;
@@ -278,38 +293,41 @@ void RenderView::paintGL() {
                     }
 
                     if (drawCycle < kCycleNormals) {
-                        const size_t numMeshes = smdl->GetMeshesCount();
-                        for (size_t k = 0; k < numMeshes; ++k) {
-                            const HalfLifeModelStudioMesh& mesh = smdl->GetMesh(k);
-                            const size_t textureIdx = mModel->GetSkinTexture(mesh.textureIndex);
-                            if (textureIdx < mTextures.size()) {
-                                if (renderTextured) {
-                                    mTextures[textureIdx].draw->bind();
+                        for (const HalfLifeModelDrawCall& drawCall : mModelInstance->GetBodyPartDrawCalls(i)) {
+                            // texture and its uniforms only change between the draw calls of different textures
+                            const size_t textureIdx = drawCall.textureIdx;
+                            if (textureIdx != boundTextureIdx) {
+                                if (textureIdx < mResources->textures.size()) {
+                                    if (renderTextured) {
+                                        mResources->textures[textureIdx].draw->bind();
+                                    } else {
+                                        mWhiteTexture->bind();
+                                    }
+
+                                    const HalfLifeModelTexture& hltexture = mModel->GetTexture(textureIdx);
+                                    mShaderModel->setUniformValue(mIsChromeLocation, hltexture.chrome);
+                                    if (renderTextured && hltexture.masked) {
+                                        mShaderModel->setUniformValue(mAlphaTestLocation, 0.5f, 0.5f, 0.5f, 0.5f);
+                                    } else {
+                                        mShaderModel->setUniformValue(mAlphaTestLocation, -1.0f, -1.0f, -1.0f, -1.0f);
+                                    }
                                 } else {
                                     mWhiteTexture->bind();
+                                    mShaderModel->setUniformValue(mIsChromeLocation, false);
+                                    mShaderModel->setUniformValue(mAlphaTestLocation, -1.0f, -1.0f, -1.0f, -1.0f);
                                 }
 
-                                const HalfLifeModelTexture& hltexture = mModel->GetTexture(textureIdx);
-                                mShaderModel->setUniformValue(mIsChromeLocation, hltexture.chrome);
-                                if (renderTextured && hltexture.masked) {
-                                    mShaderModel->setUniformValue(mAlphaTestLocation, 0.5f, 0.5f, 0.5f, 0.5f);
-                                } else {
-                                    mShaderModel->setUniformValue(mAlphaTestLocation, -1.0f, -1.0f, -1.0f, -1.0f);
+                                if (drawCycle == kCycleWireframeOverlay) {
+                                    mShaderModel->setUniformValue(mIsChromeLocation, true);
+                                    mShaderModel->setUniformValue(mForcedColorLocation, 1.0f, 0.0f, 0.95f, 1.0f);
                                 }
-                            } else {
-                                mWhiteTexture->bind();
-                                mShaderModel->setUniformValue(mIsChromeLocation, false);
-                                mShaderModel->setUniformValue(mAlphaTestLocation, -1.0f, -1.0f, -1.0f, -1.0f);
-                            }
 
-                            if (drawCycle == kCycleWireframeOverlay) {
-                                mShaderModel->setUniformValue(mIsChromeLocation, true);
-                                mShaderModel->setUniformValue(mForcedColorLocation, 1.0f, 0.0f, 0.95f, 1.0f);
+                                boundTextureIdx = textureIdx;
                             }
 
-                            glDrawElements(GL_TRIANGLES, scast<GLsizei>(mesh.numIndices), GL_UNSIGNED_SHORT, indices + mesh.indicesOffset);
+                            glDrawElements(GL_TRIANGLES, scast<GLsizei>(drawCall.numIndices), indexType, indices + drawCall.indicesOffset * indexSize);
                             if (drawCycle == kCycleDraw) {
-                                totalTriangles += mesh.numIndices / 3;
+                                totalTriangles += drawCall.numIndices / 3;
                                 totalDrawcalls++;
                             }
                         }
@@ -344,13 +362,13 @@ void RenderView::paintGL() {
                 constexpr float r = 1.0f;
                 for (size_t i = 0; i < numBones; ++i) {
                     const HalfLifeModelBone& bone = mModel->GetBone(i);
-                    const mat4f& boneTransform = mModel->GetBoneMat(i);
+                    const mat4f& boneTransform = mModelInstance->GetBoneMat(i);
                     vec3f pos(boneTransform[0][3], boneTransform[1][3], boneTransform[2][3]);
 
                     this->DebugDrawSphere(pos, r, (bone.parentIdx >= 0) ? colorPoints : colorParentPoint);
 
                     if (bone.parentIdx >= 0) {
-                        const mat4f& parentTransform = mModel->GetBoneMat(scast<size_t>(bone.parentIdx));
+                        const mat4f& parentTransform = mModelInstance->GetBoneMat(scast<size_t>(bone.parentIdx));
                         vec3f parentPos(parentTransform[0][3], parentTransform[1][3], parentTransform[2][3]);
                         this->DebugDrawTetrahedron(parentPos, pos, r, colorTets);
                     }
@@ -361,7 +379,7 @@ void RenderView::paintGL() {
 
                         ap2.x *= scast<float>(this->width());
                         ap2.y *= scast<float>(this->height());
-                        debugStrings.push_back({ QString::fromStdString(bone.name), ap2 });
+                        debugStrings.push_back({ QString::fromUtf8(bone.name.data(), scast<int>(bone.name.size())), ap2 });
                     }
                 }
 
@@ -377,7 +395,7 @@ void RenderView::paintGL() {
                 constexpr float r = 1.3f;
                 for (size_t i = 0; i < numAttachments; ++i) {
                     const HalfLifeModelAttachment& attachment = mModel->GetAttachment(i);
-                    const mat4f& boneTransform = mModel->GetBoneMat(scast<size_t>(attachment.bone));
+                    const mat4f& boneTransform = mModelInstance->GetBoneMat(scast<size_t>(attachment.bone));
                     vec3f pos = boneTransform.transformPos(attachment.origin);
 
                     this->DebugDrawSphere(pos, r, colorAttach);
@@ -392,7 +410,7 @@ void RenderView::paintGL() {
 
                         ap2.x *= scast<float>(this->width());
                         ap2.y *= scast<float>(this->height());
-                        debugStrings.push_back({ QString::fromStdString(attachment.name), ap2 });
+                        debugStrings.push_back({ QString::fromUtf8(attachment.name.data(), scast<int>(attachment.name.size())), ap2 });
                     }
                 }
 
@@ -406,7 +424,7 @@ void RenderView::paintGL() {
                 constexpr uint32_t colorBox = 0xFF0000FF;
                 for (size_t i = 0; i < numHitBoxes; ++i) {
                     const HalfLifeModelHitBox& hitbox = mModel->GetHitBox(i);
-                    const mat4f& boneTransform = mModel->GetBoneMat(hitbox.boneIdx);
+                    const mat4f& boneTransform = mModelInstance->GetBoneMat(hitbox.boneIdx);
 
                     this->DebugDrawTransformedBBox(boneTransform, hitbox.bounds, colorBox);
                 }
@@ -446,6 +464,11 @@ void RenderView::paintGL() {
             }
         }
     }
+
+    if (mModel && mFirstFramePending) {
+        mFirstFramePending = false;
+        emit firstFrameRendered();
+    }
 }
 
 void RenderView::resizeGL(int w, int h) {
@@ -711,55 +734,83 @@ void RenderView::DebugDrawTransformedBBox(const mat4f& xform, const AABBox& bbox
     mDebugVerticesCount += kNumBoxVertices;
 }
 
-void RenderView::SetModel(HalfLifeModel* mdl) {
-    mModel = mdl;
-    mTextures.clear();
-
-    mAnimationFrame = 0.0f;
-    mLastTime = QDateTime::currentDateTime();
-
-    if (mModel) {
-        if (mModel->GetBonesCount() > 0) {
-            mRenderVertices.resize(16384); // reserve
-        }
-
-        if (mModel->GetTexturesCount() > 0) {
-            const size_t numTextures = mModel->GetTexturesCount();
-            mTextures.resize(numTextures);
-
-            for (size_t i = 0; i < numTextures; ++i) {
-                const HalfLifeModelTexture& hltexture = mModel->GetTexture(i);
-                RenderTexture& renderTexture = mTextures[i];
-
-                const size_t numTextureVariants = hltexture.masked ? 2 : 1;
-                for (size_t variant = 0; variant < numTextureVariants; ++variant) {
-                    RefPtr<QOpenGLTexture>& gltexture = variant ? renderTexture.orig : renderTexture.draw;
-
-                    gltexture = MakeRefPtr<QOpenGLTexture>(QOpenGLTexture::Target2D);
-                    gltexture->setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
-                    gltexture->setWrapMode(hltexture.chrome ? QOpenGLTexture::Repeat : QOpenGLTexture::ClampToEdge);
-                    if (gltexture->create()) {
-                        gltexture->setSize(scast<int>(hltexture.width), scast<int>(hltexture.height));
-                        gltexture->setFormat(QOpenGLTexture::RGBA8_UNorm);
-                        gltexture->allocateStorage();
-
-                        MyArray<uint32_t> rgbaData(hltexture.width * hltexture.height);
-                        for (size_t j = 0, numPixels = hltexture.data.size(); j < numPixels; ++j) {
-                            const size_t idx = hltexture.data[j];
-                            rgbaData[j] = (hltexture.masked && idx == 255 && !variant) ? 0u : ((hltexture.palette[idx * 3 + 0] <<  0) |
-                                                                                               (hltexture.palette[idx * 3 + 1] <<  8) |
-                                                                                               (hltexture.palette[idx * 3 + 2] << 16) |
-                                                                                                0xFF000000);
-                        }
-                        gltexture->setData(0, QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, rgbaData.data(), nullptr);
+// uploads the model textures, the result can be reused by any number of SetModel calls
+RefPtr<RenderModelResources> RenderView::CreateModelResources(const HalfLifeModel* mdl) {
+    RefPtr<RenderModelResources> resources = MakeRefPtr<RenderModelResources>();
+
+    if (mdl && mdl->GetTexturesCount() > 0) {
+        this->makeCurrent();
+
+        const size_t numTextures = mdl->GetTexturesCount();
+        resources->textures.resize(numTextures);
+
+        for (size_t i = 0; i < numTextures; ++i) {
+            const HalfLifeModelTexture& hltexture = mdl->GetTexture(i);
+            RenderTexture& renderTexture = resources->textures[i];
+
+            const size_t numTextureVariants = hltexture.masked ? 2 : 1;
+            for (size_t variant = 0; variant < numTextureVariants; ++variant) {
+                RefPtr<QOpenGLTexture>& gltexture = variant ? renderTexture.orig : renderTexture.draw;
+
+                gltexture = MakeRefPtr<QOpenGLTexture>(QOpenGLTexture::Target2D);
+                gltexture->setMinMagFilters(QOpenGLTexture::Linear, QOpenGLTexture::Linear);
+                gltexture->setWrapMode(hltexture.chrome ? QOpenGLTexture::Repeat : QOpenGLTexture::ClampToEdge);
+                if (gltexture->create()) {
+                    gltexture->setSize(scast<int>(hltexture.width), scast<int>(hltexture.height));
+                    gltexture->setFormat(QOpenGLTexture::RGBA8_UNorm);
+                    gltexture->allocateStorage();
+
+                    MyArray<uint32_t> rgbaData(hltexture.width * hltexture.height);
+                    for (size_t j = 0, numPixels = hltexture.data.size(); j < numPixels; ++j) {
+                        const size_t idx = hltexture.data[j];
+                        rgbaData[j] = (hltexture.masked && idx == 255 && !variant) ? 0u : ((hltexture.palette[idx * 3 + 0] <<  0) |
+                                                                                           (hltexture.palette[idx * 3 + 1] <<  8) |
+                                                                                           (hltexture.palette[idx * 3 + 2] << 16) |
+                                                                                            0xFF000000);
                     }
-                }
+                    gltexture->setData(0, QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, rgbaData.data(), nullptr);
 
-                if (!hltexture.masked) {
-                    renderTexture.orig = renderTexture.draw;
+                    resources->gpuBytes += rgbaData.size() * sizeof(uint32_t);
                 }
             }
+
+            if (!hltexture.masked) {
+                renderTexture.orig = renderTexture.draw;
+            }
         }
+
+        this->doneCurrent();
+    }
+
+    return resources;
+}
+
+// GL objects can only be destroyed with our context current
+void RenderView::ReleaseModelResources(RefPtr<RenderModelResources>& resources) {
+    if (resources) {
+        this->makeCurrent();
+        resources.reset();
+        this->doneCurrent();
+    }
+}
+
+void RenderView::SetModel(HalfLifeModelInstance* mdl, const RefPtr<RenderModelResources>& resources) {
+    mModelInstance = mdl;
+    mModel = mdl ? mdl->GetModel() : nullptr;
+    mFirstFramePending = (mdl != nullptr);
+
+    // the textures of the previous model go away here unless somebody else keeps them
+    RefPtr<RenderModelResources> previousResources = std::move(mResources);
+    mResources = mdl ? resources : nullptr;
+    this->ReleaseModelResources(previousResources);
+
+    mAnimationFrame = 0.0f;
+    mLastTime = QDateTime::currentDateTime();
+
+    // pose versions of the new instance start over
+    mSkinnedBodyParts.clear();
+    if (mModel && mModel->GetBonesCount() > 0) {
+        mSkinnedBodyParts.resize(mModel->GetBodyPartsCount());
     }
 
     this->ResetView();
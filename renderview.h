@@ -13,6 +13,8 @@
 #include "mymath.h"
 
 class HalfLifeModel;
+class HalfLifeModelInstance;
+class HalfLifeModelStudioModel;
 
 PACKED_STRUCT_BEGIN
 struct RenderVertex {
@@ -81,6 +83,12 @@ struct RenderTexture {
     RefPtr<QOpenGLTexture>  orig;   // most of the time is a pointer to `draw`, except when masked
 };
 
+// everything uploaded to the GPU for a model, may outlive its use by the view (see ModelsCache)
+struct RenderModelResources {
+    MyArray<RenderTexture>  textures;
+    size_t                  gpuBytes = 0;
+};
+
 class RenderView : public QOpenGLWidget, protected QOpenGLFunctions_2_0 {
     Q_OBJECT
 
@@ -111,7 +119,9 @@ protected:
     void                            DebugDrawTransformedBBox(const mat4f& xform, const AABBox& bbox, const uint32_t color);
 
 public:
-    void                            SetModel(HalfLifeModel* mdl);
+    RefPtr<RenderModelResources>    CreateModelResources(const HalfLifeModel* mdl);
+    void                            ReleaseModelResources(RefPtr<RenderModelResources>& resources);
+    void                            SetModel(HalfLifeModelInstance* mdl, const RefPtr<RenderModelResources>& resources);
     void                            SetRenderOptions(const RenderOptions& options);
     const RenderOptions&            GetRenderOptions() const;
     void                            SetShowStats(const bool show);
@@ -119,6 +129,10 @@ public:
     void                            SetBackgroundColor(const vec4f& color);
     const vec4f&                    GetBackgroundColor() const;
 
+signals:
+    // emitted once the first frame with a newly set model has been drawn
+    void                            firstFrameRendered();
+
 private:
     QOpenGLContext*                 mGLContext;
     QBasicTimer                     mTimer;
@@ -126,9 +140,17 @@ private:
     bool                            mShowStats;
     vec4f                           mBackgroundColor;
 
-    HalfLifeModel*                  mModel;
-    MyArray<RenderVertex>           mRenderVertices;
-    MyArray<RenderTexture>          mTextures;
+    HalfLifeModelInstance*          mModelInstance;
+    const HalfLifeModel*            mModel;         // the instance's model
+    bool                            mFirstFramePending;
+    // bodyparts vertices moved by the skeleton, skinned again only when the pose or the active submodel changes
+    struct SkinnedBodyPart {
+        uint64_t                        poseVersion = 0;
+        const HalfLifeModelStudioModel* studioModel = nullptr;
+        MyArray<RenderVertex>           vertices;
+    };
+    MyArray<SkinnedBodyPart>        mSkinnedBodyParts;
+    RefPtr<RenderModelResources>    mResources;
     QDateTime                       mLastTime;
     float                           mAnimationFrame;
 
@@ -0,0 +1,328 @@
+#include "vfs.h"
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+PACKED_STRUCT_BEGIN
+struct PakHeader {
+    uint32_t    magic;
+    int32_t     dirOffset;
+    int32_t     dirLength;
+} PACKED_STRUCT_END;
+
+PACKED_STRUCT_BEGIN
+struct PakDirEntry {
+    char        name[56];
+    int32_t     offset;
+    int32_t     length;
+} PACKED_STRUCT_END;
+
+
+// maps the whole file read-only, the mapping lives as long as any stream copy refers to it
+static MemStream MapFileToMemStream(const fs::path& filePath) {
+#ifdef _WIN32
+    HANDLE file = ::CreateFileW(filePath.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return {};
+    }
+
+    LARGE_INTEGER fileSize = {};
+    if (!::GetFileSizeEx(file, &fileSize) || fileSize.QuadPart <= 0) {
+        ::CloseHandle(file);
+        return {};
+    }
+
+    HANDLE mapping = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    ::CloseHandle(file);
+    if (!mapping) {
+        return {};
+    }
+
+    void* memory = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    ::CloseHandle(mapping);
+    if (!memory) {
+        return {};
+    }
+
+    const size_t length = scast<size_t>(fileSize.QuadPart);
+    MemStream::OwnedPtrType owner(rcast<uint8_t*>(memory), [](uint8_t* ptr) {
+        ::UnmapViewOfFile(ptr);
+    });
+#else
+    const int fd = ::open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return {};
+    }
+
+    struct stat st = {};
+    if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+        ::close(fd);
+        return {};
+    }
+
+    const size_t length = scast<size_t>(st.st_size);
+    void* memory = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (memory == MAP_FAILED) {
+        return {};
+    }
+
+    MemStream::OwnedPtrType owner(rcast<uint8_t*>(memory), [length](uint8_t* ptr) {
+        ::munmap(ptr, length);
+    });
+#endif
+
+    return MemStream(memory, length, owner);
+}
+
+static MemStream ReadLooseFile(const fs::path& filePath) {
+    MemStream mapped = MapFileToMemStream(filePath);
+    if (mapped) {
+        return mapped;
+    }
+
+    // fallback for the files we can't map (special filesystems and such)
+    std::ifstream file(filePath, std::ios::binary);
+    if (!file.is_open()) {
+        return {};
+    }
+
+    file.seekg(0, std::ios::end);
+    const size_t fileSize = file.tellg();
+    char* memory = rcast<char*>(malloc(fileSize));
+    if (!memory) {
+        return {};
+    }
+
+    file.seekg(0, std::ios::beg);
+    file.read(memory, fileSize);
+    file.close();
+
+    return MemStream(memory, fileSize, true);
+}
+
+// lower case with '/' separators and no leading ones, that's how names are looked up in archives
+static CharString NormalizeArchiveFileName(const StringView& fileName) {
+    CharString result;
+    result.reserve(fileName.size());
+    for (const char c : fileName) {
+        const char ch = (c == '\\') ? '/' : scast<char>(std::tolower(scast<unsigned char>(c)));
+        if (ch != '/' || !result.empty()) {
+            result += ch;
+        }
+    }
+    return result;
+}
+
+
+PakArchive::PakArchive() {
+}
+PakArchive::~PakArchive() {
+}
+
+bool PakArchive::Open(const fs::path& archivePath) {
+    MemStream stream = ReadLooseFile(archivePath);
+    if (!stream) {
+        return false;
+    }
+
+    PakHeader header = {};
+    stream.ReadStruct(header);
+    if (header.magic != PakArchive::kPACKMagic || header.dirOffset < 0 || header.dirLength < 0) {
+        return false;
+    }
+
+    const size_t numEntries = scast<size_t>(header.dirLength) / sizeof(PakDirEntry);
+    const ArrayView<PakDirEntry> directory = stream.GetView<PakDirEntry>(scast<size_t>(header.dirOffset), numEntries);
+    if (directory.size() != numEntries) {
+        return false;
+    }
+
+    mEntries.clear();
+    mLookup.clear();
+    mEntries.reserve(numEntries);
+    mLookup.reserve(numEntries);
+    for (size_t i = 0; i < numEntries; ++i) {
+        const PakDirEntry& dirEntry = directory[i];
+        if (dirEntry.offset < 0 || dirEntry.length < 0 || scast<size_t>(dirEntry.offset) + scast<size_t>(dirEntry.length) > stream.Length()) {
+            continue;
+        }
+
+        const CharString name(dirEntry.name, strnlen(dirEntry.name, sizeof(dirEntry.name)));
+        // the first one wins, same as in the game
+        if (mLookup.emplace(NormalizeArchiveFileName(name), mEntries.size()).second) {
+            mEntries.push_back({ name, scast<size_t>(dirEntry.offset), scast<size_t>(dirEntry.length) });
+        }
+    }
+
+    mPath = archivePath;
+    mStream = stream;
+    return true;
+}
+
+const fs::path& PakArchive::GetPath() const {
+    return mPath;
+}
+
+size_t PakArchive::GetFilesCount() const {
+    return mEntries.size();
+}
+
+const CharString& PakArchive::GetFileName(const size_t idx) const {
+    return mEntries[idx].name;
+}
+
+MemStream PakArchive::OpenFile(const StringView& fileName) const {
+    auto it = mLookup.find(NormalizeArchiveFileName(fileName));
+    if (it == mLookup.end()) {
+        return {};
+    }
+
+    const Entry& entry = mEntries[it->second];
+    return mStream.SharedSubstream(entry.offset, entry.length);
+}
+
+
+struct MountedArchive {
+    RefPtr<const PakArchive>    archive;
+    VFSFileInfo                 info;       // of the archive file when it was mounted
+};
+
+static std::mutex                       sMountsLock;
+static MyDict<CharString, MountedArchive> sMounts;
+
+static bool GetLooseFileInfo(const fs::path& filePath, VFSFileInfo& info) {
+    std::error_code ec;
+    info.size = scast<uint64_t>(fs::file_size(filePath, ec));
+    if (ec) {
+        return false;
+    }
+    const fs::file_time_type mtime = fs::last_write_time(filePath, ec);
+    if (ec) {
+        return false;
+    }
+    info.mtime = scast<int64_t>(mtime.time_since_epoch().count());
+    return true;
+}
+
+bool VirtualFileSystem::IsArchive(const fs::path& path) {
+    CharString ext = path.extension().u8string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](const char c) { return scast<char>(std::tolower(scast<unsigned char>(c))); });
+    return ext == ".pak";
+}
+
+fs::path VirtualFileSystem::MakeArchiveFilePath(const fs::path& archivePath, const StringView& fileName) {
+    return archivePath / fs::u8path(NormalizeArchiveFileName(fileName));
+}
+
+RefPtr<const PakArchive> VirtualFileSystem::MountArchive(const fs::path& archivePath) {
+    VFSFileInfo info = {};
+    if (!GetLooseFileInfo(archivePath, info)) {
+        return nullptr;
+    }
+
+    std::error_code ec;
+    const CharString key = fs::absolute(archivePath, ec).lexically_normal().u8string();
+
+    std::lock_guard<std::mutex> guard(sMountsLock);
+    auto it = sMounts.find(key);
+    if (it != sMounts.end() && it->second.info.size == info.size && it->second.info.mtime == info.mtime) {
+        return it->second.archive;
+    }
+
+    // streams served by the old mount keep its mapping alive for as long as they need it
+    RefPtr<PakArchive> archive = MakeRefPtr<PakArchive>();
+    if (!archive->Open(archivePath)) {
+        sMounts.erase(key);
+        return nullptr;
+    }
+
+    sMounts[key] = { archive, info };
+    return archive;
+}
+
+// looks for an archive file along the path, `fileName` gets the rest of the path
+RefPtr<const PakArchive> VirtualFileSystem::FindArchive(const fs::path& filePath, CharString& fileName) {
+    fs::path archivePath;
+    for (auto it = filePath.begin(), end = filePath.end(); it != end; ++it) {
+        archivePath /= *it;
+        if (!VirtualFileSystem::IsArchive(archivePath)) {
+            continue;
+        }
+
+        std::error_code ec;
+        if (std::next(it) == end || !fs::is_regular_file(archivePath, ec)) {
+            continue;
+        }
+
+        fileName.clear();
+        for (auto rest = std::next(it); rest != end; ++rest) {
+            if (!fileName.empty()) {
+                fileName += '/';
+            }
+            fileName += rest->u8string();
+        }
+        return VirtualFileSystem::MountArchive(archivePath);
+    }
+
+    return nullptr;
+}
+
+MemStream VirtualFileSystem::ReadFile(const fs::path& filePath) {
+    CharString fileName;
+    const RefPtr<const PakArchive> archive = VirtualFileSystem::FindArchive(filePath, fileName);
+    if (archive) {
+        return archive->OpenFile(fileName);
+    }
+
+    return ReadLooseFile(filePath);
+}
+
+bool VirtualFileSystem::GetFileInfo(const fs::path& filePath, VFSFileInfo& info) {
+    CharString fileName;
+    const RefPtr<const PakArchive> archive = VirtualFileSystem::FindArchive(filePath, fileName);
+    if (archive) {
+        // no I/O here, the substream is just a view into the mapping
+        const MemStream stream = archive->OpenFile(fileName);
+        if (!stream || !GetLooseFileInfo(archive->GetPath(), info)) {
+            return false;
+        }
+        info.size = stream.Length();
+        return true;
+    }
+
+    return GetLooseFileInfo(filePath, info);
+}
+
+bool VirtualFileSystem::Exists(const fs::path& filePath) {
+    VFSFileInfo info = {};
+    return VirtualFileSystem::GetFileInfo(filePath, info);
+}
+
+// does nothing for the files we had to read, their memory is not a mapping
+void VirtualFileSystem::Prefetch(const MemStream& stream) {
+    if (!stream.Length()) {
+        return;
+    }
+
+    // archived files don't start at page boundaries
+    constexpr uintptr_t kPageSize = 4096;
+    const uintptr_t start = rcast<uintptr_t>(stream.Data()) & ~(kPageSize - 1);
+    const size_t length = scast<size_t>(rcast<uintptr_t>(stream.Data()) + stream.Length() - start);
+
+#ifdef _WIN32
+    WIN32_MEMORY_RANGE_ENTRY range = { rcast<void*>(start), length };
+    ::PrefetchVirtualMemory(::GetCurrentProcess(), 1, &range, 0);
+#else
+    ::madvise(rcast<void*>(start), length, MADV_WILLNEED);
+#endif
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "mycommon.h"
+
+struct VFSFileInfo {
+    uint64_t    size;
+    int64_t     mtime;      // files inside of an archive have the archive's one
+};
+
+// Half-Life (Quake) .pak archive, the directory is indexed once on open and files are served
+// as substreams of the mapped archive, nothing is extracted or copied
+class PakArchive {
+    static const uint32_t kPACKMagic = MakeFourcc<'P','A','C','K'>();
+
+public:
+    PakArchive();
+    ~PakArchive();
+
+    bool                            Open(const fs::path& archivePath);
+
+    const fs::path&                 GetPath() const;
+    size_t                          GetFilesCount() const;
+    const CharString&               GetFileName(const size_t idx) const;
+    // names are case insensitive and separated by '/'
+    MemStream                       OpenFile(const StringView& fileName) const;
+
+private:
+    struct Entry {
+        CharString  name;
+        size_t      offset;
+        size_t      length;
+    };
+
+    fs::path                        mPath;
+    MemStream                       mStream;
+    MyArray<Entry>                  mEntries;
+    MyDict<CharString, size_t>      mLookup;    // normalized name -> entry index
+};
+
+// loose files and files inside of .pak archives behind the same paths, an archive acts as a folder:
+// `valve/pak0.pak/models/barney.mdl`, archives are mounted on the first access and stay mounted,
+// an archive changed on disk is mounted anew
+class VirtualFileSystem {
+public:
+    static bool                     IsArchive(const fs::path& path);
+    static fs::path                 MakeArchiveFilePath(const fs::path& archivePath, const StringView& fileName);
+    static RefPtr<const PakArchive> MountArchive(const fs::path& archivePath);
+
+    static MemStream                ReadFile(const fs::path& filePath);
+    static bool                     GetFileInfo(const fs::path& filePath, VFSFileInfo& info);
+    static bool                     Exists(const fs::path& filePath);
+
+    // asks the OS to start reading the stream memory in the background, works on any part of a mapped file
+    static void                     Prefetch(const MemStream& stream);
+
+private:
+    static RefPtr<const PakArchive> FindArchive(const fs::path& filePath, CharString& fileName);
+};